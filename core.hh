@@ -1,10 +1,139 @@
 #pragma once
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <sys/stat.h>
+
 #define BYTE4N_FLT(x) ((static_cast<f32>(x) / 255.f) * 2.f - 1.f)
 
 namespace core
 {
 	using namespace UFG;
 
+	enum : u32
+	{
+		MATERIAL_PARAM_DIFFUSE_MAP = 0xDCE06689,
+		MATERIAL_PARAM_BUMP_MAP = 0xADBE1A5A
+	};
+
+	enum ExportFormat : u8
+	{
+		EXPORT_FORMAT_FBX,			// FBX SDK
+		EXPORT_FORMAT_FBX_NATIVE,	// Built-in binary FBX writer
+		EXPORT_FORMAT_GLB,			// Built-in glTF 2.0 binary writer
+#ifndef PERMTOFBX_NO_FBXSDK
+		EXPORT_FORMAT_DEFAULT = EXPORT_FORMAT_FBX
+#else
+		EXPORT_FORMAT_DEFAULT = EXPORT_FORMAT_FBX_NATIVE
+#endif
+	};
+
+	bool GetExportFormat(const char* name, ExportFormat& format)
+	{
+#ifndef PERMTOFBX_NO_FBXSDK
+		if (qStringCompareInsensitive(name, "fbx") == 0)
+		{
+			format = EXPORT_FORMAT_FBX;
+			return 1;
+		}
+#endif
+
+		if (qStringCompareInsensitive(name, "fbx-native") == 0)
+		{
+			format = EXPORT_FORMAT_FBX_NATIVE;
+			return 1;
+		}
+
+		if (qStringCompareInsensitive(name, "glb") == 0)
+		{
+			format = EXPORT_FORMAT_GLB;
+			return 1;
+		}
+
+		return 0;
+	}
+
+	// Axis system of the source data, output is always Y-up, right handed (parity odd).
+	// Anything other than native is converted while vertices & bind poses are decoded (-axis=).
+	enum AxisSystem : u8
+	{
+		AXIS_SYSTEM_NATIVE,	// Written as stored
+		AXIS_SYSTEM_Z_UP,	// Z-up, right handed -> rotated -90 degrees around X
+	};
+
+	bool GetAxisSystem(const char* name, AxisSystem& axis)
+	{
+		if (qStringCompareInsensitive(name, "native") == 0)
+		{
+			axis = AXIS_SYSTEM_NATIVE;
+			return 1;
+		}
+
+		if (qStringCompareInsensitive(name, "z-up") == 0)
+		{
+			axis = AXIS_SYSTEM_Z_UP;
+			return 1;
+		}
+
+		return 0;
+	}
+
+	AxisSystem gAxisSystem = AXIS_SYSTEM_NATIVE;
+
+	// Export all models sharing a rig into one scene with a single skeleton (-combine=rig).
+	bool gCombineByRig = 0;
+
+	// Deflate large arrays in files written by the native writers (-compress).
+	bool gCompressArrays = 0;
+
+	// Keep vertex data in compact integer formats where the output format allows it (-quantize).
+	bool gQuantizeVertices = 0;
+
+	std::mutex gLogMutex;
+
+	// Collects log lines of a single export so concurrent workers don't interleave their output.
+	class LogBuffer
+	{
+	public:
+		std::string mText;
+
+		void Printf(const char* format, ...)
+		{
+			char buffer[1024];
+
+			va_list args;
+			va_start(args, format);
+			int length = vsnprintf(buffer, sizeof(buffer), format, args);
+			va_end(args);
+
+			if (length > 0) {
+				mText.append(buffer, (static_cast<size_t>(length) < sizeof(buffer) ? static_cast<size_t>(length) : sizeof(buffer) - 1));
+			}
+		}
+
+		void Flush()
+		{
+			if (mText.empty()) {
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(gLogMutex);
+				fwrite(mText.data(), 1, mText.size(), stdout);
+				fflush(stdout);
+			}
+
+			mText.clear();
+		}
+	};
+
 	const char* GetParamValue(const char* arg, const qString& param)
 	{
 		if (const char* find = qStringFindInsensitive(arg, param)) {
@@ -14,64 +143,146 @@ namespace core
 		return 0;
 	}
 
-	bool IsPermFile(const qString& path)
+	// -jobs= value, only plain numbers are accepted (0 = all cores), main clamps it to the hardware threads.
+	bool GetJobCount(const char* value, u32& count)
 	{
-		qString path2 = path.ToLower();
-		return (path2.EndsWith(".bin") && !path2.EndsWith(".temp.bin"));
+		if (!isdigit(static_cast<unsigned char>(value[0]))) {
+			return 0;
+		}
+
+		char* end = 0;
+		unsigned long long jobs = strtoull(value, &end, 10);
+
+		if (*end || jobs > 0xFFFFFFFFull) {
+			return 0;
+		}
+
+		count = static_cast<u32>(jobs);
+		return 1;
 	}
 
-	void LoadPermFiles(const qString& find_path)
+	// -mem-budget= value in MiB, only plain positive numbers are accepted (no sign, suffix or overflow).
+	bool GetMemoryBudget(const char* value, u64& budget)
 	{
-		WIN32_FIND_DATAA wFindData = { 0 };
-		HANDLE hFind = FindFirstFileA(find_path, &wFindData);
-
-		if (hFind == INVALID_HANDLE_VALUE) {
-			return;
+		if (!isdigit(static_cast<unsigned char>(value[0]))) {
+			return 0;
 		}
 
-		char* end = &find_path.mData[find_path.mLength - 2];
-		bool recursive = (end[0] == '*' && end[1] == '*');
+		char* end = 0;
+		unsigned long long megabytes = strtoull(value, &end, 10);
 
-		qString folder = find_path.GetFilePath() + "\\";
+		if (*end || !megabytes || megabytes > (~0ull >> 20)) {
+			return 0;
+		}
 
-		do
+		budget = static_cast<u64>(megabytes) << 20;
+		return 1;
+	}
+
+	// Perm files end with ".bin" but not ".temp.bin", checked in place so directory scans don't build strings for skipped names.
+	bool IsPermFileName(const char* name, size_t length)
+	{
+		auto ends_with = [name, length](const char* suffix)
 		{
-			qString file_path = (folder + wFindData.cFileName);
+			size_t suffix_length = strlen(suffix);
+			if (suffix_length > length) {
+				return 0;
+			}
 
-			if (wFindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			for (size_t i = 0; suffix_length > i; ++i)
 			{
-				if (wFindData.cFileName[0] == '.') {
-					continue;
+				if (tolower(static_cast<unsigned char>(name[length - suffix_length + i])) != suffix[i]) {
+					return 0;
 				}
+			}
 
-				if (recursive)
-				{
-					file_path += "\\**";
-					LoadPermFiles(file_path);
-				}
+			return 1;
+		};
 
-				continue;
-			}
+		return (ends_with(".bin") && !ends_with(".temp.bin"));
+	}
 
-			if (IsPermFile(file_path)) {
-				StreamResourceLoader::LoadResourceFile(file_path);
+	bool IsPermFile(const qString& path)
+	{
+		return IsPermFileName(path.mData, path.mLength);
+	}
+
+	bool GetFileInfo(const char* path, u64& size, u64& modified_time)
+	{
+#ifdef _WIN32
+		struct _stat64 st;
+		if (_stat64(path, &st)) {
+			return 0;
+		}
+#else
+		struct stat st;
+		if (stat(path, &st)) {
+			return 0;
+		}
+#endif
+		size = static_cast<u64>(st.st_size);
+		modified_time = static_cast<u64>(st.st_mtime);
+		return 1;
+	}
+
+	u64 GetFileSize(const char* path)
+	{
+		u64 size = 0, modified_time = 0;
+		GetFileInfo(path, size, modified_time);
+		return size;
+	}
+
+	// Only .perm.bin files are streamed, everything else (rigs, globals) stays loaded for the whole run.
+	bool IsStreamedFile(const std::string& path)
+	{
+		static const char suffix[] = ".perm.bin";
+		const size_t length = sizeof(suffix) - 1;
+
+		if (length > path.size()) {
+			return 0;
+		}
+
+		for (size_t i = 0; length > i; ++i)
+		{
+			if (tolower(static_cast<unsigned char>(path[path.size() - length + i])) != suffix[i]) {
+				return 0;
 			}
-		} while (FindNextFileA(hFind, &wFindData));
+		}
 
-		FindClose(hFind);
+		return 1;
 	}
 
-	Illusion::VertexStreamDescriptor* GetVertexStreamDescriptor(u32 name_uid)
+	// Perm files loaded together: "Sandra.perm.bin" and its texture sets "Sandra_TS00.perm.bin" share "sandra".
+	std::string GetPermGroupKey(const std::string& path)
 	{
-		auto streamDescriptors = Illusion::VertexStreamDescriptor::GetStreamDescriptors();
-		for (auto streamDescriptor = streamDescriptors->begin(); streamDescriptor != streamDescriptors->end(); streamDescriptor = streamDescriptor->next())
+		std::string key = path;
+		for (auto& c : key) {
+			c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+		}
+
+		if (IsStreamedFile(key)) {
+			key.resize(key.size() - 9);
+		}
+
+		size_t ts = key.rfind("_ts");
+		if (ts != std::string::npos && key.size() > (ts + 3))
 		{
-			if (streamDescriptor->mNameUID == name_uid) {
-				return streamDescriptor;
+			bool digits = 1;
+			for (size_t i = ts + 3; key.size() > i; ++i) {
+				digits &= (isdigit(static_cast<unsigned char>(key[i])) != 0);
+			}
+
+			if (digits) {
+				key.resize(ts);
 			}
 		}
 
-		return 0;
+		return key;
+	}
+
+	Illusion::VertexStreamDescriptor* GetVertexStreamDescriptor(u32 name_uid)
+	{
+		return ResourceIndex::GetVertexDecl(name_uid);
 	}
 
 	Illusion::VertexStreamElement* GetVertexStreamElement(Illusion::VertexStreamDescriptor* stream_descriptor, Illusion::VertexStreamElementUsage usage)
@@ -93,42 +304,116 @@ namespace core
 		return vertex_buffer->mData.Get(offset);
 	}
 
-	void InitMeshHandles(Illusion::Mesh* mesh)
+	// Vertices of a (possibly shared) vertex buffer that a mesh actually references.
+	// mVertices holds the source vertex indices in ascending order, mIndices the mesh triangles remapped onto them.
+	struct MeshVertexRange
 	{
-		auto warehouse = qResourceWarehouse::Instance();
+		std::vector<u32> mVertices;
+		std::vector<u32> mIndices;
+	};
 
-		mesh->mMaterialHandle.mData = warehouse->DebugGet(RTypeUID_Material, mesh->mMaterialHandle.mNameUID);
-		mesh->mIndexBufferHandle.mData = warehouse->DebugGet(RTypeUID_Buffer, mesh->mIndexBufferHandle.mNameUID);
+	template <typename T>
+	FORCE_INLINE u32 LoadIndex(const u8* indices, u32 i)
+	{
+		T index;
+		memcpy(&index, &indices[sizeof(T) * i], sizeof(T));
+		return static_cast<u32>(index);
+	}
 
-		for (auto& vertexBufferHandle : mesh->mVertexBufferHandles) {
-			vertexBufferHandle.mData = warehouse->DebugGet(RTypeUID_Buffer, vertexBufferHandle.mNameUID);
+	// Triangle list, index width known at compile time so the loop has no per index width handling.
+	template <typename T>
+	bool ReadTriangleList(const u8* indices, u32 num_indices, u32 num_vertices, u32* out, u32& min_index, u32& max_index)
+	{
+		for (u32 i = 0; num_indices > i; ++i)
+		{
+			u32 index = LoadIndex<T>(indices, i);
+			if (index >= num_vertices) {
+				return 0;
+			}
+
+			min_index = (min_index > index ? index : min_index);
+			max_index = (index > max_index ? index : max_index);
+			out[i] = index;
 		}
+
+		return 1;
 	}
 
-	bool ValidateBonesWithRig(RigResource* rig, Illusion::BonePalette* bone_palette)
+	// Meshes are read as triangle lists (mNumPrims * 3 indices from mIndexStart).
+	bool BuildMeshVertexRange(Illusion::Mesh* mesh, Illusion::Buffer* index_buffer, u32 num_vertices, MeshVertexRange& range)
 	{
-		auto skeleton = rig->mSkeleton;
+		const u32 element_size = index_buffer->mElementByteSize;
+
+		const u32 num_indices = mesh->mNumPrims * 3;
+
+		range.mIndices.resize(num_indices);
+		range.mVertices.clear();
+
+		auto indices = static_cast<const u8*>(index_buffer->mData.Get(element_size * mesh->mIndexStart));
+		u32 min_index = 0xFFFFFFFF;
+		u32 max_index = 0;
+		bool valid = 0;
 
-		for (u32 b = 0; bone_palette->mNumBones > b; ++b)
+		switch (element_size)
 		{
-			bool found = 0;
-			u32 bone_uid = *bone_palette->mBoneUIDTable[b];
+		case 1:
+			valid = ReadTriangleList<u8>(indices, num_indices, num_vertices, range.mIndices.data(), min_index, max_index);
+			break;
+		case 2:
+			valid = ReadTriangleList<u16>(indices, num_indices, num_vertices, range.mIndices.data(), min_index, max_index);
+			break;
+		case 4:
+			valid = ReadTriangleList<u32>(indices, num_indices, num_vertices, range.mIndices.data(), min_index, max_index);
+			break;
+		}
 
-			for (int i = 0; skeleton->m_bones.m_size > i; ++i)
-			{
-				auto bone = &skeleton->m_bones.m_data[i];
-				if (qStringHashUpper32(bone->m_name) == bone_uid)
-				{
-					found = 1;
-					break;
-				}
-			}
+		if (!valid) {
+			return 0;
+		}
 
-			if (!found) {
-				return 0;
+		if (range.mIndices.empty()) {
+			return 1;
+		}
+
+		// Remap only the [min, max] window so meshes of a big shared buffer don't pay for the whole buffer.
+		std::vector<u32> remap((max_index - min_index) + 1, 0xFFFFFFFF);
+
+		for (u32 index : range.mIndices) {
+			remap[index - min_index] = 0;
+		}
+
+		for (u32 i = 0; remap.size() > i; ++i)
+		{
+			if (remap[i] == 0xFFFFFFFF) {
+				continue;
 			}
+
+			remap[i] = static_cast<u32>(range.mVertices.size());
+			range.mVertices.push_back(min_index + i);
+		}
+
+		for (u32& index : range.mIndices) {
+			index = remap[index - min_index];
 		}
 
 		return 1;
 	}
+
+	void InitMeshHandles(Illusion::Mesh* mesh)
+	{
+		mesh->mMaterialHandle.mData = ResourceIndex::Get(RTypeUID_Material, mesh->mMaterialHandle.mNameUID);
+		mesh->mIndexBufferHandle.mData = ResourceIndex::Get(RTypeUID_Buffer, mesh->mIndexBufferHandle.mNameUID);
+
+		for (auto& vertexBufferHandle : mesh->mVertexBufferHandles) {
+			vertexBufferHandle.mData = ResourceIndex::Get(RTypeUID_Buffer, vertexBufferHandle.mNameUID);
+		}
+	}
+
+	// Resolves all mesh handles up front so the export itself only reads shared resource data.
+	void InitModelHandles(Illusion::Model* model)
+	{
+		for (u32 m = 0; model->mNumMeshes > m; ++m) {
+			InitMeshHandles(model->GetMesh(m));
+		}
+	}
 }
\ No newline at end of file
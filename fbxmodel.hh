@@ -1,14 +1,22 @@
 #pragma once
+#include <unordered_map>
+
+static_assert(sizeof(fbxsdk::FbxVector4) == sizeof(double) * 4, "FbxVector4 layout doesn't match qModelMesh arrays");
+static_assert(sizeof(fbxsdk::FbxVector2) == sizeof(double) * 2, "FbxVector2 layout doesn't match qModelMesh arrays");
 
 class qFBXModel
 {
 public:
 	fbxsdk::FbxScene* mScene = 0;
+	std::unordered_map<u32, fbxsdk::FbxSurfacePhong*> mMaterials;	// Material UID -> phong shared by every mesh using it
+	std::unordered_map<u64, fbxsdk::FbxFileTexture*> mTextures;		// qModelMaterial::GetTextureKey -> texture
 
 	qFBXModel(fbxsdk::FbxManager* mgr)
 	{
 		mScene = fbxsdk::FbxScene::Create(mgr, "");
 
+		// Vertices & bind poses are already converted while decoding (-axis=), the scene only declares the axis system.
+		mScene->GetGlobalSettings().SetAxisSystem(fbxsdk::FbxAxisSystem(fbxsdk::FbxAxisSystem::EUpVector::eYAxis, fbxsdk::FbxAxisSystem::EFrontVector::eParityOdd, fbxsdk::FbxAxisSystem::eRightHanded));
 		mScene->GetGlobalSettings().SetSystemUnit(FbxSystemUnit::m);
 	}
 
@@ -19,8 +27,7 @@ public:
 
 	bool Export(fbxsdk::FbxManager* mgr, const char* filename)
 	{
-		fbxsdk::FbxAxisSystem targetSystem(fbxsdk::FbxAxisSystem::EUpVector::eYAxis, fbxsdk::FbxAxisSystem::EFrontVector::eParityOdd, fbxsdk::FbxAxisSystem::eRightHanded);
-		targetSystem.DeepConvertScene(mScene);
+		PROFILE_SCOPE("FbxExporter", filename);
 
 		FbxExporter* exporter = FbxExporter::Create(mgr, "");
 
@@ -46,43 +53,44 @@ public:
 		return mesh;
 	}
 
-	fbxsdk::FbxSurfacePhong* CreateDiffuseMaterial(const char* name, const char* filename, const char* uvset)
+	fbxsdk::FbxFileTexture* GetTexture(const qModelMaterial& material, const char* uvset)
 	{
-		auto fileTexture = fbxsdk::FbxFileTexture::Create(mScene, name);
-		fileTexture->SetFileName(filename);
-		fileTexture->SetTextureUse(fbxsdk::FbxTexture::eStandard);
+		auto& fileTexture = mTextures[material.GetTextureKey()];
+		if (fileTexture) {
+			return fileTexture;
+		}
+
+		fileTexture = fbxsdk::FbxFileTexture::Create(mScene, material.mName.c_str());
+		fileTexture->SetFileName(material.mTextureFilename.c_str());
+		fileTexture->SetTextureUse(material.mType == qModelMaterial::TYPE_DIFFUSE ? fbxsdk::FbxTexture::eStandard : fbxsdk::FbxTexture::eBumpNormalMap);
 		fileTexture->SetMappingType(fbxsdk::FbxTexture::eUV);
 		fileTexture->SetMaterialUse(fbxsdk::FbxFileTexture::eModelMaterial);
 		fileTexture->SetSwapUV(0);
 		fileTexture->UVSet.Set(uvset);
 
-		auto material = fbxsdk::FbxSurfacePhong::Create(mScene, name);
-		material->Diffuse.Set(fbxsdk::FbxDouble3(1, 1, 1));
-		material->DiffuseFactor.Set(1.0);
-		material->Diffuse.ConnectSrcObject(fileTexture);
-
-		return material;
+		return fileTexture;
 	}
 
-	fbxsdk::FbxSurfacePhong* CreateBumpMaterial(const char* name, const char* filename, const char* uvset)
+	// One phong per material, diffuse & bump textures are connected the first time a mesh lists them.
+	fbxsdk::FbxSurfacePhong* GetMaterial(const qModelMaterial& material, const char* uvset)
 	{
-		auto fileTexture = fbxsdk::FbxFileTexture::Create(mScene, name);
-		fileTexture->SetFileName(filename);
-		fileTexture->SetTextureUse(fbxsdk::FbxTexture::eBumpNormalMap);
-		fileTexture->SetMappingType(fbxsdk::FbxTexture::eUV);
-		fileTexture->SetMaterialUse(fbxsdk::FbxFileTexture::eModelMaterial);
-		fileTexture->SetSwapUV(0);
-		fileTexture->UVSet.Set(uvset);
+		auto& phong = mMaterials[material.mMaterialUID];
+		if (!phong) {
+			phong = fbxsdk::FbxSurfacePhong::Create(mScene, material.mName.c_str());
+		}
 
-		auto layeredTexture = fbxsdk::FbxLayeredTexture::Create(mScene, "");
-		layeredTexture->SetTextureUse(fbxsdk::FbxLayeredTexture::eBumpNormalMap);
-		layeredTexture->ConnectSrcObject(fileTexture);
+		auto& property = (material.mType == qModelMaterial::TYPE_DIFFUSE ? phong->Diffuse : phong->Bump);
+		if (!property.GetSrcObjectCount())
+		{
+			property.Set(fbxsdk::FbxDouble3(1, 1, 1));
+			property.ConnectSrcObject(GetTexture(material, uvset));
 
-		auto material = fbxsdk::FbxSurfacePhong::Create(mScene, name);
-		material->Bump.Set(fbxsdk::FbxDouble3(1, 1, 1));
-		material->Bump.ConnectSrcObject(fileTexture);
+			if (material.mType == qModelMaterial::TYPE_DIFFUSE) {
+				phong->DiffuseFactor.Set(1.0);
+			}
+		}
 
-		return material;
+		return phong;
 	}
 
 	fbxsdk::FbxSkin* CreateSkin(const char* name)
@@ -118,4 +126,164 @@ public:
 
 		return cluster;
 	}
-};
\ No newline at end of file
+
+	// Builds the scene graph (skeleton, meshes, materials & skin) from the decoded model.
+	void Build(const qModelData& data)
+	{
+		PROFILE_SCOPE("FbxBuildScene", data.mName.c_str());
+
+		fbxsdk::FbxArray<fbxsdk::FbxNode*> fbxBoneNodes;
+
+		for (auto& bone : data.mBones)
+		{
+			fbxsdk::FbxAMatrix matrix;
+			matrix.SetT(fbxsdk::FbxVector4(bone.mTranslation[0], bone.mTranslation[1], bone.mTranslation[2]));
+			matrix.SetQ(fbxsdk::FbxQuaternion(bone.mRotation[0], bone.mRotation[1], bone.mRotation[2], bone.mRotation[3]));
+			matrix.SetS(fbxsdk::FbxVector4(bone.mScale[0], bone.mScale[1], bone.mScale[2]));
+
+			fbxBoneNodes.Add(CreateLimbNode(bone.mName.c_str(), matrix));
+		}
+
+		for (int i = 0; fbxBoneNodes.Size() > i; ++i)
+		{
+			int parent = data.mBones[i].mParent;
+
+			if (parent == -1) {
+				mScene->GetRootNode()->AddChild(fbxBoneNodes[i]);
+			}
+			else {
+				fbxBoneNodes[parent]->AddChild(fbxBoneNodes[i]);
+			}
+		}
+
+		for (auto& modelMesh : data.mMeshes)
+		{
+			auto fbxMesh = CreateMesh(modelMesh.mName.c_str(), static_cast<int>(modelMesh.mNumVertices));
+			auto fbxNode = fbxMesh->GetNode();
+
+			auto fbxUV = fbxMesh->CreateElementUV("UV0");
+			fbxUV->SetMappingMode(fbxsdk::FbxGeometryElement::eByPolygonVertex);
+			fbxUV->SetReferenceMode(fbxsdk::FbxGeometryElement::eIndexToDirect);
+
+			// Material
+
+			for (auto& material : modelMesh.mMaterials)
+			{
+				auto fbxMaterial = GetMaterial(material, fbxUV->GetName());
+				if (!fbxNode->IsConnectedSrcObject(fbxMaterial)) {
+					fbxNode->AddMaterial(fbxMaterial);
+				}
+			}
+
+			// Positions
+
+			memcpy(fbxMesh->GetControlPoints(), modelMesh.mPositions.data(), sizeof(double) * modelMesh.mPositions.size());
+
+			// Normals
+
+			if (!modelMesh.mNormals.empty())
+			{
+				auto fbxNormal = fbxMesh->CreateElementNormal();
+				fbxNormal->SetMappingMode(fbxsdk::FbxGeometryElement::eByControlPoint);
+				fbxNormal->SetReferenceMode(fbxsdk::FbxGeometryElement::eDirect);
+
+				auto& directArray = fbxNormal->GetDirectArray();
+				directArray.Resize(static_cast<int>(modelMesh.mNumVertices));
+
+				auto normals = directArray.GetLocked(fbxsdk::FbxLayerElementArray::eWriteLock);
+				memcpy(normals, modelMesh.mNormals.data(), sizeof(double) * modelMesh.mNormals.size());
+				directArray.Release(&normals);
+			}
+
+			// Texture Coord
+
+			if (!modelMesh.mUVs.empty())
+			{
+				auto& directArray = fbxUV->GetDirectArray();
+				directArray.Resize(static_cast<int>(modelMesh.mNumVertices));
+
+				auto uvs = directArray.GetLocked(fbxsdk::FbxLayerElementArray::eWriteLock);
+				memcpy(uvs, modelMesh.mUVs.data(), sizeof(double) * modelMesh.mUVs.size());
+				directArray.Release(&uvs);
+			}
+
+			// Polygons
+
+			const int num_indices = static_cast<int>(modelMesh.mIndices.size());
+			fbxMesh->ReservePolygonCount(num_indices / 3);
+			fbxMesh->ReservePolygonVertexCount(num_indices);
+
+			auto indices = reinterpret_cast<const int*>(modelMesh.mIndices.data());
+			for (int p = 0; num_indices > p; p += 3)
+			{
+				fbxMesh->BeginPolygon();
+				fbxMesh->AddPolygon(indices[p]);
+				fbxMesh->AddPolygon(indices[p + 1]);
+				fbxMesh->AddPolygon(indices[p + 2]);
+				fbxMesh->EndPolygon();
+			}
+
+			// UV indices are the polygon vertices (eIndexToDirect onto per control point UVs), filled in one go.
+			{
+				auto& indexArray = fbxUV->GetIndexArray();
+				indexArray.Resize(num_indices);
+
+				auto uvIndices = indexArray.GetLocked(fbxsdk::FbxLayerElementArray::eWriteLock);
+				memcpy(uvIndices, indices, sizeof(int) * num_indices);
+				indexArray.Release(&uvIndices);
+			}
+
+			// Skin
+
+			if (!modelMesh.mClusters.empty())
+			{
+				auto fbxSkin = CreateSkin(data.mSkinName.c_str());
+				auto& matrix = fbxNode->EvaluateGlobalTransform();
+
+				for (auto& cluster : modelMesh.mClusters)
+				{
+					if (0 > cluster.mBone) {
+						continue;
+					}
+
+					auto fbxCluster = CreateCluster(fbxSkin, fbxBoneNodes[cluster.mBone], matrix);
+
+					for (size_t i = 0; cluster.mIndices.size() > i; ++i) {
+						fbxCluster->AddControlPointIndex(cluster.mIndices[i], cluster.mWeights[i]);
+					}
+				}
+
+				fbxMesh->AddDeformer(fbxSkin);
+			}
+		}
+	}
+};
+
+// FBX SDK backend, owns its manager since the SDK isn't safe to share between threads.
+class qFBXSDKWriter : public qModelSink
+{
+public:
+	fbxsdk::FbxManager* mMgr = 0;
+
+	qFBXSDKWriter()
+	{
+		mMgr = fbxsdk::FbxManager::Create();
+
+		auto ios = fbxsdk::FbxIOSettings::Create(mMgr, IOSROOT);
+		mMgr->SetIOSettings(ios);
+	}
+
+	~qFBXSDKWriter()
+	{
+		mMgr->Destroy();
+	}
+
+	const char* GetExtension() const override { return "fbx"; }
+
+	bool Write(const qModelData& data, const char* filename) override
+	{
+		qFBXModel fbxModel(mMgr);
+		fbxModel.Build(data);
+		return fbxModel.Export(mMgr, filename);
+	}
+};
@@ -0,0 +1,849 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <zlib.h>
+
+// Binary FBX 7.4 writer serializing qModelData straight into a buffer, no FBX SDK scene graph involved.
+
+class qFBXWriter : public qModelSink
+{
+public:
+	struct Connection
+	{
+		const char* mType;
+		int64_t mChild;
+		int64_t mParent;
+		const char* mProperty;
+	};
+
+	struct Node
+	{
+		size_t mHeader;
+		size_t mPropsBegin;
+		u32 mNumProps;
+		bool mHasChildren;
+	};
+
+	bool mCompress = 0;
+	std::vector<u8> mBuffer;
+	std::vector<Node> mNodes;
+	std::vector<Connection> mConnections;
+	std::vector<u8> mDeflateBuffer;
+	std::unordered_map<u32, int64_t> mMaterialIDs;	// Material UID -> object shared by every mesh using it
+	std::unordered_map<u64, int64_t> mTextureIDs;	// qModelMaterial::GetTextureKey -> object
+	int64_t mNextID = 1000000;
+
+	static constexpr u32 kVersion = 7400;
+	static constexpr u32 kCompressMinSize = 128;
+
+	//--------------------------------------------------
+	//	Node Records
+	//--------------------------------------------------
+
+	void Append(const void* data, size_t size)
+	{
+		auto bytes = static_cast<const u8*>(data);
+		mBuffer.insert(mBuffer.end(), bytes, &bytes[size]);
+	}
+
+	template <typename T>
+	void Append(T value) { Append(&value, sizeof(T)); }
+
+	void Patch(size_t offset, u32 value) { memcpy(&mBuffer[offset], &value, sizeof(value)); }
+
+	// Properties of the parent must be complete before its first child starts.
+	void ClosePropertyList(Node& node)
+	{
+		if (node.mHasChildren) {
+			return;
+		}
+
+		node.mHasChildren = 1;
+		Patch(node.mHeader + 4, node.mNumProps);
+		Patch(node.mHeader + 8, static_cast<u32>(mBuffer.size() - node.mPropsBegin));
+	}
+
+	void BeginNode(const char* name)
+	{
+		if (!mNodes.empty()) {
+			ClosePropertyList(mNodes.back());
+		}
+
+		const u8 name_length = static_cast<u8>(strlen(name));
+
+		Node node = { mBuffer.size(), 0, 0, 0 };
+		Append<u32>(0); // EndOffset
+		Append<u32>(0); // NumProperties
+		Append<u32>(0); // PropertyListLen
+		Append<u8>(name_length);
+		Append(name, name_length);
+		node.mPropsBegin = mBuffer.size();
+
+		mNodes.push_back(node);
+	}
+
+	void EndNode()
+	{
+		Node node = mNodes.back();
+		mNodes.pop_back();
+
+		const bool sentinel = (node.mHasChildren || !node.mNumProps);
+		if (!node.mHasChildren)
+		{
+			Patch(node.mHeader + 4, node.mNumProps);
+			Patch(node.mHeader + 8, static_cast<u32>(mBuffer.size() - node.mPropsBegin));
+		}
+
+		if (sentinel) {
+			mBuffer.insert(mBuffer.end(), 13, 0);
+		}
+
+		Patch(node.mHeader, static_cast<u32>(mBuffer.size()));
+	}
+
+	//--------------------------------------------------
+	//	Properties
+	//--------------------------------------------------
+
+	void PropI32(int value) { Append<u8>('I'); Append(value); ++mNodes.back().mNumProps; }
+	void PropI64(int64_t value) { Append<u8>('L'); Append(value); ++mNodes.back().mNumProps; }
+	void PropF64(double value) { Append<u8>('D'); Append(value); ++mNodes.back().mNumProps; }
+
+	void PropString(const char* str, size_t length)
+	{
+		Append<u8>('S');
+		Append(static_cast<u32>(length));
+		Append(str, length);
+		++mNodes.back().mNumProps;
+	}
+
+	void PropString(const char* str) { PropString(str, strlen(str)); }
+	void PropString(const std::string& str) { PropString(str.data(), str.size()); }
+
+	// "Name\x00\x01Class" as used by object names.
+	void PropObjectName(const std::string& name, const char* object_class)
+	{
+		std::string str = name;
+		str.push_back('\0');
+		str.push_back('\x01');
+		str += object_class;
+		PropString(str);
+	}
+
+	void PropRaw(const void* data, u32 size)
+	{
+		Append<u8>('R');
+		Append(size);
+		Append(data, size);
+		++mNodes.back().mNumProps;
+	}
+
+	template <typename T>
+	void PropArray(u8 type, const T* data, size_t count)
+	{
+		const uLong size = static_cast<uLong>(sizeof(T) * count);
+
+		Append<u8>(type);
+		Append(static_cast<u32>(count));
+
+		if (mCompress && size >= kCompressMinSize)
+		{
+			uLongf compressed_size = compressBound(size);
+			mDeflateBuffer.resize(compressed_size);
+
+			if (compress2(mDeflateBuffer.data(), &compressed_size, reinterpret_cast<const Bytef*>(data), size, Z_BEST_SPEED) == Z_OK)
+			{
+				Append<u32>(1);
+				Append(static_cast<u32>(compressed_size));
+				Append(mDeflateBuffer.data(), compressed_size);
+				++mNodes.back().mNumProps;
+				return;
+			}
+		}
+
+		Append<u32>(0);
+		Append(static_cast<u32>(size));
+		Append(data, size);
+		++mNodes.back().mNumProps;
+	}
+
+	void PropArray(const std::vector<double>& values) { PropArray('d', values.data(), values.size()); }
+	void PropArray(const std::vector<int>& values) { PropArray('i', values.data(), values.size()); }
+
+	//--------------------------------------------------
+	//	Helpers
+	//--------------------------------------------------
+
+	void NodeI32(const char* name, int value) { BeginNode(name); PropI32(value); EndNode(); }
+	void NodeF64(const char* name, double value) { BeginNode(name); PropF64(value); EndNode(); }
+	void NodeString(const char* name, const char* value) { BeginNode(name); PropString(value); EndNode(); }
+	void NodeString(const char* name, const std::string& value) { BeginNode(name); PropString(value); EndNode(); }
+
+	// Properties70 entry: P: "name", "type", "label", "flags", values...
+	void BeginP(const char* name, const char* type, const char* label, const char* flags)
+	{
+		BeginNode("P");
+		PropString(name);
+		PropString(type);
+		PropString(label);
+		PropString(flags);
+	}
+
+	void PInt(const char* name, int value) { BeginP(name, "int", "Integer", ""); PropI32(value); EndNode(); }
+	void PDouble(const char* name, double value) { BeginP(name, "double", "Number", ""); PropF64(value); EndNode(); }
+
+	void PVector(const char* name, const char* type, const char* label, const char* flags, const double* value)
+	{
+		BeginP(name, type, label, flags);
+		PropF64(value[0]);
+		PropF64(value[1]);
+		PropF64(value[2]);
+		EndNode();
+	}
+
+	int64_t CreateID() { return mNextID++; }
+
+	void Connect(int64_t child, int64_t parent) { mConnections.push_back({ "OO", child, parent, 0 }); }
+	void ConnectProperty(int64_t child, int64_t parent, const char* property) { mConnections.push_back({ "OP", child, parent, property }); }
+
+	//--------------------------------------------------
+	//	Math
+	//--------------------------------------------------
+
+	// Quaternion to XYZ euler angles in degrees (FBX default rotation order).
+	static void QuaternionToEuler(const double* q, double* euler)
+	{
+		const double x = q[0], y = q[1], z = q[2], w = q[3];
+		const double rad_to_deg = 57.295779513082320876798;
+
+		const double m00 = 1.0 - 2.0 * (y * y + z * z);
+		const double m10 = 2.0 * (x * y + w * z);
+		const double m20 = 2.0 * (x * z - w * y);
+		const double m21 = 2.0 * (y * z + w * x);
+		const double m22 = 1.0 - 2.0 * (x * x + y * y);
+
+		double sy = -m20;
+		sy = (sy > 1.0 ? 1.0 : (-1.0 > sy ? -1.0 : sy));
+
+		if (0.9999999 > fabs(sy))
+		{
+			euler[0] = atan2(m21, m22);
+			euler[1] = asin(sy);
+			euler[2] = atan2(m10, m00);
+		}
+		else
+		{
+			const double m11 = 1.0 - 2.0 * (x * x + z * z);
+			const double m12 = 2.0 * (y * z - w * x);
+
+			euler[0] = atan2(-m12, m11);
+			euler[1] = asin(sy);
+			euler[2] = 0.0;
+		}
+
+		for (int i = 0; 3 > i; ++i) {
+			euler[i] *= rad_to_deg;
+		}
+	}
+
+	//--------------------------------------------------
+	//	Sections
+	//--------------------------------------------------
+
+	void WriteHeader()
+	{
+		static const char magic[] = "Kaydara FBX Binary  ";
+		Append(magic, sizeof(magic)); // Includes the terminating zero
+		Append<u8>(0x1A);
+		Append<u8>(0x00);
+		Append(kVersion);
+
+		BeginNode("FBXHeaderExtension");
+		{
+			NodeI32("FBXHeaderVersion", 1003);
+			NodeI32("FBXVersion", static_cast<int>(kVersion));
+			NodeI32("EncryptionType", 0);
+			NodeString("Creator", "PermToFBX");
+		}
+		EndNode();
+
+		// Fixed id & time, the footer id below is derived from them.
+		static const u8 file_id[16] = { 0x28, 0xB3, 0x2A, 0xEB, 0xB6, 0x24, 0xCC, 0xC2, 0xBF, 0xC8, 0xB0, 0x2A, 0xA9, 0x2B, 0xFC, 0xF1 };
+		BeginNode("FileId");
+		PropRaw(file_id, sizeof(file_id));
+		EndNode();
+
+		NodeString("CreationTime", "1970-01-01 10:00:00:000");
+		NodeString("Creator", "PermToFBX");
+	}
+
+	void WriteGlobalSettings()
+	{
+		BeginNode("GlobalSettings");
+		{
+			NodeI32("Version", 1000);
+
+			BeginNode("Properties70");
+			{
+				// Y-up, right handed, parity odd & meters, same as qFBXModel.
+				PInt("UpAxis", 1);
+				PInt("UpAxisSign", 1);
+				PInt("FrontAxis", 2);
+				PInt("FrontAxisSign", 1);
+				PInt("CoordAxis", 0);
+				PInt("CoordAxisSign", 1);
+				PInt("OriginalUpAxis", 1);
+				PInt("OriginalUpAxisSign", 1);
+				PDouble("UnitScaleFactor", 100.0);
+				PDouble("OriginalUnitScaleFactor", 100.0);
+			}
+			EndNode();
+		}
+		EndNode();
+	}
+
+	void WriteDocuments()
+	{
+		BeginNode("Documents");
+		{
+			NodeI32("Count", 1);
+
+			BeginNode("Document");
+			PropI64(CreateID());
+			PropString("Scene");
+			PropString("Scene");
+			{
+				BeginNode("Properties70");
+				EndNode();
+
+				BeginNode("RootNode");
+				PropI64(0);
+				EndNode();
+			}
+			EndNode();
+		}
+		EndNode();
+
+		BeginNode("References");
+		EndNode();
+	}
+
+	void WriteDefinitions(const qModelData& data)
+	{
+		std::unordered_set<u32> materials;
+		std::unordered_set<u64> textures;
+		int num_clusters = 0;
+		int num_skins = 0;
+
+		for (auto& mesh : data.mMeshes)
+		{
+			for (auto& material : mesh.mMaterials)
+			{
+				materials.insert(material.mMaterialUID);
+				textures.insert(material.GetTextureKey());
+			}
+
+			if (!mesh.mClusters.empty())
+			{
+				++num_skins;
+				for (auto& cluster : mesh.mClusters) {
+					num_clusters += (0 > cluster.mBone ? 0 : 1);
+				}
+			}
+		}
+
+		const int num_meshes = static_cast<int>(data.mMeshes.size());
+		const int num_bones = static_cast<int>(data.mBones.size());
+
+		struct { const char* mName; int mCount; } types[] =
+		{
+			{ "GlobalSettings", 1 },
+			{ "Model", num_meshes + num_bones },
+			{ "Geometry", num_meshes },
+			{ "Material", static_cast<int>(materials.size()) },
+			{ "Texture", static_cast<int>(textures.size()) },
+			{ "NodeAttribute", num_bones },
+			{ "Deformer", num_skins + num_clusters },
+		};
+
+		int total = 0;
+		for (auto& type : types) {
+			total += type.mCount;
+		}
+
+		BeginNode("Definitions");
+		{
+			NodeI32("Version", 100);
+			NodeI32("Count", total);
+
+			for (auto& type : types)
+			{
+				if (!type.mCount) {
+					continue;
+				}
+
+				BeginNode("ObjectType");
+				PropString(type.mName);
+				NodeI32("Count", type.mCount);
+				EndNode();
+			}
+		}
+		EndNode();
+	}
+
+	int64_t WriteModel(const std::string& name, const char* type, const double* translation, const double* rotation, const double* scale)
+	{
+		int64_t id = CreateID();
+
+		BeginNode("Model");
+		PropI64(id);
+		PropObjectName(name, "Model");
+		PropString(type);
+		{
+			NodeI32("Version", 232);
+
+			BeginNode("Properties70");
+			if (translation)
+			{
+				PVector("Lcl Translation", "Lcl Translation", "", "A", translation);
+				PVector("Lcl Rotation", "Lcl Rotation", "", "A", rotation);
+				PVector("Lcl Scaling", "Lcl Scaling", "", "A", scale);
+			}
+			EndNode();
+
+			NodeString("Culling", "CullingOff");
+		}
+		EndNode();
+
+		return id;
+	}
+
+	void BeginLayerElement(const char* element, const char* name, const char* mapping, const char* reference)
+	{
+		BeginNode(element);
+		PropI32(0);
+
+		NodeI32("Version", 101);
+		NodeString("Name", name);
+		NodeString("MappingInformationType", mapping);
+		NodeString("ReferenceInformationType", reference);
+	}
+
+	void WriteLayerElementRef(const char* type)
+	{
+		BeginNode("LayerElement");
+		NodeString("Type", type);
+		NodeI32("TypedIndex", 0);
+		EndNode();
+	}
+
+	int64_t WriteGeometry(const qModelMesh& mesh)
+	{
+		int64_t id = CreateID();
+
+		BeginNode("Geometry");
+		PropI64(id);
+		PropObjectName(mesh.mName, "Geometry");
+		PropString("Mesh");
+		{
+			BeginNode("Properties70");
+			EndNode();
+
+			NodeI32("GeometryVersion", 124);
+
+			std::vector<double> values(static_cast<size_t>(mesh.mNumVertices) * 3);
+
+			for (u32 v = 0; mesh.mNumVertices > v; ++v) {
+				memcpy(&values[v * 3], &mesh.mPositions[v * 4], sizeof(double) * 3);
+			}
+
+			BeginNode("Vertices");
+			PropArray(values);
+			EndNode();
+
+			// Last index of every polygon is stored as ~index.
+			std::vector<int> polygonIndices(mesh.mIndices.size());
+
+			for (size_t i = 0; mesh.mIndices.size() > i; ++i)
+			{
+				int index = static_cast<int>(mesh.mIndices[i]);
+				polygonIndices[i] = ((i % 3) == 2 ? ~index : index);
+			}
+
+			BeginNode("PolygonVertexIndex");
+			PropArray(polygonIndices);
+			EndNode();
+
+			if (!mesh.mNormals.empty())
+			{
+				for (u32 v = 0; mesh.mNumVertices > v; ++v) {
+					memcpy(&values[v * 3], &mesh.mNormals[v * 4], sizeof(double) * 3);
+				}
+
+				BeginLayerElement("LayerElementNormal", "", "ByVertice", "Direct");
+				BeginNode("Normals");
+				PropArray(values);
+				EndNode();
+				EndNode();
+			}
+
+			if (!mesh.mUVs.empty())
+			{
+				BeginLayerElement("LayerElementUV", "UV0", "ByPolygonVertex", "IndexToDirect");
+
+				BeginNode("UV");
+				PropArray(mesh.mUVs);
+				EndNode();
+
+				BeginNode("UVIndex");
+				PropArray('i', reinterpret_cast<const int*>(mesh.mIndices.data()), mesh.mIndices.size());
+				EndNode();
+
+				EndNode();
+			}
+
+			if (!mesh.mMaterials.empty())
+			{
+				const int material_index = 0;
+
+				BeginLayerElement("LayerElementMaterial", "", "AllSame", "IndexToDirect");
+				BeginNode("Materials");
+				PropArray('i', &material_index, 1);
+				EndNode();
+				EndNode();
+			}
+
+			BeginNode("Layer");
+			PropI32(0);
+			{
+				NodeI32("Version", 100);
+
+				if (!mesh.mNormals.empty()) {
+					WriteLayerElementRef("LayerElementNormal");
+				}
+
+				if (!mesh.mUVs.empty()) {
+					WriteLayerElementRef("LayerElementUV");
+				}
+
+				if (!mesh.mMaterials.empty()) {
+					WriteLayerElementRef("LayerElementMaterial");
+				}
+			}
+			EndNode();
+		}
+		EndNode();
+
+		return id;
+	}
+
+	// Phong with every texture the mesh lists for the material (diffuse and/or bump), textures are written once per scene.
+	int64_t WriteMaterial(const qModelMesh& mesh, const qModelMaterial& material)
+	{
+		static const double one[3] = { 1.0, 1.0, 1.0 };
+		int64_t id = CreateID();
+
+		BeginNode("Material");
+		PropI64(id);
+		PropObjectName(material.mName, "Material");
+		PropString("");
+		{
+			NodeI32("Version", 102);
+			NodeString("ShadingModel", "phong");
+			NodeI32("MultiLayer", 0);
+
+			BeginNode("Properties70");
+			for (auto& channel : mesh.mMaterials)
+			{
+				if (channel.mMaterialUID != material.mMaterialUID) {
+					continue;
+				}
+
+				if (channel.mType == qModelMaterial::TYPE_DIFFUSE)
+				{
+					PVector("DiffuseColor", "Color", "", "A", one);
+					BeginP("DiffuseFactor", "Number", "", "A");
+					PropF64(1.0);
+					EndNode();
+				}
+				else {
+					PVector("Bump", "Vector3D", "Vector", "", one);
+				}
+			}
+			EndNode();
+		}
+		EndNode();
+
+		for (auto& channel : mesh.mMaterials)
+		{
+			if (channel.mMaterialUID != material.mMaterialUID) {
+				continue;
+			}
+
+			auto& textureID = mTextureIDs[channel.GetTextureKey()];
+			if (!textureID) {
+				textureID = WriteTexture(channel);
+			}
+
+			ConnectProperty(textureID, id, (channel.mType == qModelMaterial::TYPE_DIFFUSE ? "DiffuseColor" : "Bump"));
+		}
+
+		return id;
+	}
+
+	int64_t WriteTexture(const qModelMaterial& material)
+	{
+		int64_t id = CreateID();
+
+		BeginNode("Texture");
+		PropI64(id);
+		PropObjectName(material.mName, "Texture");
+		PropString("");
+		{
+			NodeString("Type", "TextureVideoClip");
+			NodeI32("Version", 202);
+
+			BeginNode("TextureName");
+			PropObjectName(material.mName, "Texture");
+			EndNode();
+
+			BeginNode("Properties70");
+			{
+				BeginP("UVSet", "KString", "", "");
+				PropString("UV0");
+				EndNode();
+
+				BeginP("UseMaterial", "bool", "", "");
+				PropI32(1);
+				EndNode();
+			}
+			EndNode();
+
+			BeginNode("Media");
+			PropObjectName(material.mName, "Video");
+			EndNode();
+
+			NodeString("FileName", material.mTextureFilename);
+			NodeString("RelativeFilename", material.mTextureFilename);
+			NodeString("Texture_Alpha_Source", "None");
+		}
+		EndNode();
+
+		return id;
+	}
+
+	void WriteFooter()
+	{
+		static const u8 footer_id[16] = { 0xFA, 0xBC, 0xAB, 0x09, 0xD0, 0xC8, 0xD4, 0x66, 0xB1, 0x76, 0xFB, 0x83, 0x1C, 0xF7, 0x26, 0x7E };
+		static const u8 footer_magic[16] = { 0xF8, 0x5A, 0x8C, 0x6A, 0xDE, 0xF5, 0xD9, 0x7E, 0xEC, 0xE9, 0x0C, 0xE3, 0x75, 0x8F, 0x29, 0x0B };
+
+		// Top level null record
+		mBuffer.insert(mBuffer.end(), 13, 0);
+
+		Append(footer_id, sizeof(footer_id));
+		Append<u32>(0);
+
+		size_t padding = ((mBuffer.size() + 15) & ~static_cast<size_t>(15)) - mBuffer.size();
+		mBuffer.insert(mBuffer.end(), (padding ? padding : 16), 0);
+
+		Append(kVersion);
+		mBuffer.insert(mBuffer.end(), 120, 0);
+		Append(footer_magic, sizeof(footer_magic));
+	}
+
+	//--------------------------------------------------
+	//	Write
+	//--------------------------------------------------
+
+	const char* GetExtension() const override { return "fbx"; }
+
+	bool Write(const qModelData& data, const char* filename) override
+	{
+		mBuffer.clear();
+		mNodes.clear();
+		mConnections.clear();
+		mMaterialIDs.clear();
+		mTextureIDs.clear();
+
+		size_t reserve = 64 * 1024;
+		for (auto& mesh : data.mMeshes) {
+			reserve += (mesh.mPositions.size() + mesh.mNormals.size() + mesh.mUVs.size()) * sizeof(double) + mesh.mIndices.size() * sizeof(int) * 2;
+		}
+		mBuffer.reserve(reserve);
+
+		WriteHeader();
+		WriteGlobalSettings();
+		WriteDocuments();
+		WriteDefinitions(data);
+
+		BeginNode("Objects");
+		{
+			// Skeleton
+
+			std::vector<int64_t> boneIDs(data.mBones.size());
+			std::vector<qModelMatrix> boneMatrices;
+			data.GetBoneMatrices(boneMatrices);
+
+			for (size_t i = 0; data.mBones.size() > i; ++i)
+			{
+				auto& bone = data.mBones[i];
+
+				double rotation[3];
+				QuaternionToEuler(bone.mRotation, rotation);
+
+				boneIDs[i] = WriteModel(bone.mName, "LimbNode", bone.mTranslation, rotation, bone.mScale);
+
+				int64_t attributeID = CreateID();
+				BeginNode("NodeAttribute");
+				PropI64(attributeID);
+				PropObjectName(bone.mName, "NodeAttribute");
+				PropString("LimbNode");
+				NodeString("TypeFlags", "Skeleton");
+				EndNode();
+
+				Connect(attributeID, boneIDs[i]);
+			}
+
+			for (size_t i = 0; data.mBones.size() > i; ++i)
+			{
+				int parent = data.mBones[i].mParent;
+				Connect(boneIDs[i], (0 > parent ? 0 : boneIDs[parent]));
+			}
+
+			// Meshes
+
+			const qModelMatrix identity = qModelMatrix::Identity();
+
+			for (auto& mesh : data.mMeshes)
+			{
+				int64_t modelID = WriteModel(mesh.mName, "Mesh", 0, 0, 0);
+				int64_t geometryID = WriteGeometry(mesh);
+
+				Connect(modelID, 0);
+				Connect(geometryID, modelID);
+
+				for (size_t m = 0; mesh.mMaterials.size() > m; ++m)
+				{
+					auto& material = mesh.mMaterials[m];
+
+					// Diffuse & bump entries of a material share one object, connected once per mesh.
+					bool connected = 0;
+					for (size_t p = 0; m > p; ++p) {
+						connected |= (mesh.mMaterials[p].mMaterialUID == material.mMaterialUID);
+					}
+
+					if (connected) {
+						continue;
+					}
+
+					auto& materialID = mMaterialIDs[material.mMaterialUID];
+					if (!materialID) {
+						materialID = WriteMaterial(mesh, material);
+					}
+
+					Connect(materialID, modelID);
+				}
+
+				if (mesh.mClusters.empty()) {
+					continue;
+				}
+
+				int64_t skinID = CreateID();
+				BeginNode("Deformer");
+				PropI64(skinID);
+				PropObjectName(data.mSkinName, "Deformer");
+				PropString("Skin");
+				{
+					NodeI32("Version", 101);
+					NodeF64("Link_DeformAcuracy", 50.0);
+				}
+				EndNode();
+
+				Connect(skinID, geometryID);
+
+				for (auto& cluster : mesh.mClusters)
+				{
+					if (0 > cluster.mBone) {
+						continue;
+					}
+
+					auto& bone = data.mBones[cluster.mBone];
+
+					int64_t clusterID = CreateID();
+					BeginNode("Deformer");
+					PropI64(clusterID);
+					PropObjectName(bone.mName, "SubDeformer");
+					PropString("Cluster");
+					{
+						NodeI32("Version", 100);
+
+						BeginNode("UserData");
+						PropString("");
+						PropString("");
+						EndNode();
+
+						if (!cluster.mIndices.empty())
+						{
+							BeginNode("Indexes");
+							PropArray(cluster.mIndices);
+							EndNode();
+
+							BeginNode("Weights");
+							PropArray(cluster.mWeights);
+							EndNode();
+						}
+
+						BeginNode("Transform");
+						PropArray('d', identity.m, 16);
+						EndNode();
+
+						BeginNode("TransformLink");
+						PropArray('d', boneMatrices[cluster.mBone].m, 16);
+						EndNode();
+					}
+					EndNode();
+
+					Connect(clusterID, skinID);
+					Connect(boneIDs[cluster.mBone], clusterID);
+				}
+			}
+		}
+		EndNode();
+
+		BeginNode("Connections");
+		for (auto& connection : mConnections)
+		{
+			BeginNode("C");
+			PropString(connection.mType);
+			PropI64(connection.mChild);
+			PropI64(connection.mParent);
+			if (connection.mProperty) {
+				PropString(connection.mProperty);
+			}
+			EndNode();
+		}
+		EndNode();
+
+		BeginNode("Takes");
+		NodeString("Current", "");
+		EndNode();
+
+		WriteFooter();
+
+		FILE* file = fopen(filename, "wb");
+		if (!file) {
+			return 0;
+		}
+
+		bool written = (fwrite(mBuffer.data(), 1, mBuffer.size(), file) == mBuffer.size());
+		fclose(file);
+
+		return written;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,164 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// Perm files are read ahead on I/O threads while StreamResourceLoader registers them one by one in list order,
+// so by the time a file is loaded its pages are already cached and chunk registration stays deterministic.
+// Files aren't memory mapped: StreamResourceLoader only loads from a path into buffers it owns, so mapping perm
+// files needs an in-memory loader on the engine side (theory) first.
+
+namespace FileLoader
+{
+	using namespace UFG;
+
+	constexpr u32 kNumThreads = 4;
+	constexpr u32 kReadAhead = 8;
+	constexpr size_t kReadSize = 1 << 20;
+
+	// Pulls the whole file into the page cache without copying it to user space where the OS allows it, so the
+	// StreamResourceLoader read that follows is the only copy.
+	void PrefetchFile(const char* path)
+	{
+		PROFILE_SCOPE("PrefetchFile", path);
+
+#ifdef _WIN32
+		// Windows has no cache-only read ahead, each I/O thread reads into one reused buffer and throws the data away.
+		static thread_local std::vector<u8> buffer(kReadSize);
+
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+		if (file == INVALID_HANDLE_VALUE) {
+			return;
+		}
+
+		DWORD read = 0;
+		while (ReadFile(file, buffer.data(), static_cast<DWORD>(kReadSize), &read, 0) && read) {}
+
+		CloseHandle(file);
+#else
+		int fd = open(path, O_RDONLY);
+		if (fd == -1) {
+			return;
+		}
+
+		struct stat st;
+		if (!fstat(fd, &st) && st.st_size > 0)
+		{
+	#ifdef __linux__
+			// Blocks until the pages are cached, so Prefetcher::Wait still means "read".
+			readahead(fd, 0, static_cast<size_t>(st.st_size));
+	#elif defined(POSIX_FADV_WILLNEED)
+			posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+	#endif
+		}
+
+		close(fd);
+#endif
+	}
+
+	// Keeps up to kReadAhead files past the one being loaded in flight on the I/O pool.
+	class Prefetcher
+	{
+	public:
+		const std::vector<std::string>& mFiles;
+		jobs::TaskPool mPool;
+		std::mutex mMutex;
+		std::condition_variable mFileRead;
+		std::vector<u8> mRead;
+		size_t mNextFile = 0;
+
+		Prefetcher(const std::vector<std::string>& files) : mFiles(files), mRead(files.size(), 0)
+		{
+			if (1 >= files.size()) {
+				return;
+			}
+
+			mPool.Start(kNumThreads, kReadAhead);
+
+			while (kReadAhead > mNextFile && mFiles.size() > mNextFile) {
+				PushNext();
+			}
+		}
+
+		~Prefetcher()
+		{
+			mPool.Wait();
+			mPool.Stop();
+		}
+
+		void PushNext()
+		{
+			size_t index = mNextFile++;
+
+			mPool.Push([this, index]()
+			{
+				PrefetchFile(mFiles[index].c_str());
+
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					mRead[index] = 1;
+				}
+				mFileRead.notify_all();
+			});
+		}
+
+		// Blocks until files[index] has been read and queues the next file of the window.
+		void Wait(size_t index)
+		{
+			if (mPool.mThreads.empty()) {
+				return;
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mFileRead.wait(lock, [this, index]() { return mRead[index] != 0; });
+			}
+
+			if (mFiles.size() > mNextFile) {
+				PushNext();
+			}
+		}
+	};
+
+	//--------------------------------------------------
+	//	Load & Unload
+	//--------------------------------------------------
+
+	// Loads the files in order, reading the following ones ahead in the background.
+	void LoadFiles(const std::vector<std::string>& files)
+	{
+		PROFILE_SCOPE("LoadFiles");
+
+		if (Profile::gEnabled)
+		{
+			Profile::Add(Profile::COUNTER_FILES_LOADED, files.size());
+
+			for (auto& file : files) {
+				Profile::Add(Profile::COUNTER_BYTES_LOADED, core::GetFileSize(file.c_str()));
+			}
+		}
+
+		Prefetcher prefetcher(files);
+
+		for (size_t i = 0; files.size() > i; ++i)
+		{
+			prefetcher.Wait(i);
+
+			PROFILE_SCOPE("LoadResourceFile", files[i].c_str());
+			StreamResourceLoader::LoadResourceFile(files[i].c_str());
+		}
+	}
+
+	void UnloadFiles(const std::vector<std::string>& files)
+	{
+		for (auto& file : files) {
+			StreamResourceLoader::UnloadResourceFile(file.c_str());
+		}
+	}
+}
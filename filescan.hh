@@ -0,0 +1,367 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+#ifdef __linux__
+	#include <sys/syscall.h>
+#endif
+
+// Perm file discovery for wildcard arguments: "Data\*", "Data\**" or globs such as "Data/**/*_TS??.perm.bin".
+// The leading part without wildcards is the root, the rest is matched per path component ('*' and '?' never cross
+// a separator, "**" matches any number of directories). Subdirectories are walked in parallel and only names
+// passing the pattern and core::IsPermFileName are turned into paths.
+
+namespace FileScan
+{
+	using namespace UFG;
+
+#ifdef _WIN32
+	constexpr char kSeparator = '\\';
+#else
+	constexpr char kSeparator = '/';
+#endif
+	constexpr u32 kMaxThreads = 8;
+
+	// Pattern components, at most 63 so a match state fits into a mask (bit n = end of pattern).
+	class Pattern
+	{
+	public:
+		std::vector<std::string> mParts;
+
+		static bool IsSeparator(char c) { return (c == '\\' || c == '/'); }
+
+		static bool MatchPart(const char* pattern, const char* name, size_t length)
+		{
+			const char* end = &name[length];
+			const char* star = 0;
+			const char* star_name = 0;
+
+			while (name != end)
+			{
+				if (*pattern == '*')
+				{
+					star = pattern++;
+					star_name = name;
+				}
+				else if (*pattern == '?' || tolower(static_cast<unsigned char>(*pattern)) == tolower(static_cast<unsigned char>(*name)))
+				{
+					++pattern;
+					++name;
+				}
+				else if (star)
+				{
+					pattern = &star[1];
+					name = ++star_name;
+				}
+				else {
+					return 0;
+				}
+			}
+
+			while (*pattern == '*') {
+				++pattern;
+			}
+
+			return (*pattern == 0);
+		}
+
+		u64 GetEnd() const { return (1ull << mParts.size()); }
+
+		// Adds the states reachable without consuming a component ("**" may match none).
+		u64 Close(u64 state) const
+		{
+			for (size_t i = 0; mParts.size() > i; ++i)
+			{
+				if ((state & (1ull << i)) && mParts[i] == "**") {
+					state |= (1ull << (i + 1));
+				}
+			}
+			return state;
+		}
+
+		u64 Advance(u64 state, const char* name, size_t length) const
+		{
+			u64 next = 0;
+
+			for (size_t i = 0; mParts.size() > i; ++i)
+			{
+				if (!(state & (1ull << i))) {
+					continue;
+				}
+
+				if (mParts[i] == "**") {
+					next |= (1ull << i);
+				}
+				else if (MatchPart(mParts[i].c_str(), name, length)) {
+					next |= (1ull << (i + 1));
+				}
+			}
+
+			return Close(next);
+		}
+	};
+
+	// Splits "root/parts" at the first component containing a wildcard.
+	bool ParsePattern(const char* find_path, std::string& root, Pattern& pattern)
+	{
+		std::vector<std::string> parts;
+		std::string part;
+
+		for (const char* c = find_path; ; ++c)
+		{
+			if (*c && !Pattern::IsSeparator(*c))
+			{
+				part += *c;
+				continue;
+			}
+
+			if (!part.empty() || parts.empty()) {
+				parts.push_back(part);
+			}
+
+			part.clear();
+
+			if (!*c) {
+				break;
+			}
+		}
+
+		size_t first = 0;
+		while (parts.size() > first && parts[first].find_first_of("*?") == std::string::npos) {
+			++first;
+		}
+
+		if (first == parts.size() || (parts.size() - first) >= 64) {
+			return 0;
+		}
+
+		root.clear();
+		for (size_t i = 0; first > i; ++i)
+		{
+			root += parts[i];
+			root += kSeparator;
+		}
+
+		pattern.mParts.assign(parts.begin() + first, parts.end());
+		return 1;
+	}
+
+	struct Directory
+	{
+		std::string mPath; // Ends with a separator, empty for the working directory
+		u64 mState;
+	};
+
+	class Scanner
+	{
+	public:
+		const Pattern& mPattern;
+		std::mutex mMutex;
+		std::condition_variable mDirectoryAdded;
+		std::vector<Directory> mPending;
+		u32 mNumBusy = 0;
+		std::vector<std::vector<std::string>> mFiles; // Per worker
+
+		Scanner(const Pattern& pattern, u32 num_workers) : mPattern(pattern), mFiles(num_workers) {}
+
+		void OnEntry(const Directory& directory, const char* name, size_t length, bool is_directory, std::vector<Directory>& subdirectories, std::vector<std::string>& files)
+		{
+			if (name[0] == '.') {
+				return;
+			}
+
+			u64 state = mPattern.Advance(directory.mState, name, length);
+			if (!state) {
+				return;
+			}
+
+			if (is_directory)
+			{
+				if (state & (mPattern.GetEnd() - 1)) {
+					subdirectories.push_back({ directory.mPath + std::string(name, length) + kSeparator, state });
+				}
+				return;
+			}
+
+			if ((state & mPattern.GetEnd()) && core::IsPermFileName(name, length)) {
+				files.push_back(directory.mPath + std::string(name, length));
+			}
+		}
+
+		void ReadDirectory(const Directory& directory, std::vector<Directory>& subdirectories, std::vector<std::string>& files)
+		{
+#ifdef _WIN32
+			WIN32_FIND_DATAA wFindData;
+			HANDLE hFind = FindFirstFileExA((directory.mPath + "*").c_str(), FindExInfoBasic, &wFindData, FindExSearchNameMatch, 0, FIND_FIRST_EX_LARGE_FETCH);
+
+			if (hFind == INVALID_HANDLE_VALUE) {
+				return;
+			}
+
+			do {
+				// Linked directories (junctions) aren't followed, they may form cycles.
+				if ((wFindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && (wFindData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+					continue;
+				}
+
+				OnEntry(directory, wFindData.cFileName, strlen(wFindData.cFileName), (wFindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0, subdirectories, files);
+			} while (FindNextFileA(hFind, &wFindData));
+
+			FindClose(hFind);
+#else
+			int fd = openat(AT_FDCWD, (directory.mPath.empty() ? "." : directory.mPath.c_str()), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd == -1) {
+				return;
+			}
+
+			auto on_entry = [&](const char* name, unsigned char type)
+			{
+				bool is_directory = (type == DT_DIR);
+
+				if (type == DT_UNKNOWN)
+				{
+					struct stat st;
+					is_directory = (!fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) && S_ISDIR(st.st_mode));
+				}
+				else if (type == DT_LNK)
+				{
+					// Linked files count, linked directories aren't followed since they may form cycles.
+					struct stat st;
+					if (!fstatat(fd, name, &st, 0) && S_ISDIR(st.st_mode)) {
+						return;
+					}
+				}
+
+				OnEntry(directory, name, strlen(name), is_directory, subdirectories, files);
+			};
+
+	#ifdef __linux__
+			// Raw getdents64 fills a large buffer per call instead of one libc record at a time.
+			struct linux_dirent64
+			{
+				u64 d_ino;
+				int64_t d_off;
+				unsigned short d_reclen;
+				unsigned char d_type;
+				char d_name[1];
+			};
+
+			alignas(8) char buffer[32 * 1024];
+
+			for (;;)
+			{
+				long size = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+				if (0 >= size) {
+					break;
+				}
+
+				for (long offset = 0; size > offset;)
+				{
+					auto entry = reinterpret_cast<linux_dirent64*>(&buffer[offset]);
+					on_entry(entry->d_name, entry->d_type);
+					offset += entry->d_reclen;
+				}
+			}
+
+			close(fd);
+	#else
+			DIR* dir = fdopendir(fd);
+			if (!dir)
+			{
+				close(fd);
+				return;
+			}
+
+			while (auto entry = readdir(dir)) {
+				on_entry(entry->d_name, entry->d_type);
+			}
+
+			closedir(dir);
+	#endif
+#endif
+		}
+
+		void Run(u32 worker)
+		{
+			std::vector<Directory> subdirectories;
+
+			for (;;)
+			{
+				Directory directory;
+				{
+					std::unique_lock<std::mutex> lock(mMutex);
+					mDirectoryAdded.wait(lock, [this]() { return !mPending.empty() || !mNumBusy; });
+
+					if (mPending.empty()) {
+						return;
+					}
+
+					directory = std::move(mPending.back());
+					mPending.pop_back();
+					++mNumBusy;
+				}
+
+				subdirectories.clear();
+				ReadDirectory(directory, subdirectories, mFiles[worker]);
+
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					--mNumBusy;
+
+					for (auto& subdirectory : subdirectories) {
+						mPending.push_back(std::move(subdirectory));
+					}
+				}
+				mDirectoryAdded.notify_all();
+			}
+		}
+	};
+
+	// Appends every perm file matching find_path, sorted & without duplicates.
+	void FindPermFiles(const char* find_path, std::vector<std::string>& files)
+	{
+		PROFILE_SCOPE("ScanFiles", find_path);
+
+		std::string root;
+		Pattern pattern;
+
+		if (!ParsePattern(find_path, root, pattern)) {
+			return;
+		}
+
+		u32 num_workers = jobs::GetHardwareThreads();
+		if (num_workers > kMaxThreads) {
+			num_workers = kMaxThreads;
+		}
+
+		Scanner scanner(pattern, num_workers);
+		scanner.mPending.push_back({ root, pattern.Close(1) });
+
+		jobs::ParallelFor(num_workers, num_workers, [&](u32, u32 worker) { scanner.Run(worker); });
+
+		std::vector<std::string> found;
+		for (auto& workerFiles : scanner.mFiles) {
+			found.insert(found.end(), std::make_move_iterator(workerFiles.begin()), std::make_move_iterator(workerFiles.end()));
+		}
+
+		std::sort(found.begin(), found.end());
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+
+		files.insert(files.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+	}
+
+	bool HasWildcard(const char* path)
+	{
+		return (strpbrk(path, "*?") != 0);
+	}
+}
@@ -0,0 +1,718 @@
+#pragma once
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// glTF 2.0 binary (GLB) writer, every vertex stream becomes one tightly packed buffer view in the BIN chunk.
+// Textures reference the DDS files written by TextureManager (MSFT_texture_dds).
+// With mQuantize set normals, texcoords & weights keep (roughly) the precision of the source buffers
+// (BYTE4N, HALF2, u8) instead of being widened to floats, normals need KHR_mesh_quantization then.
+
+class qGLBWriter : public qModelSink
+{
+public:
+	enum : u32
+	{
+		GLB_MAGIC = 0x46546C67, // "glTF"
+		GLB_VERSION = 2,
+		GLB_CHUNK_JSON = 0x4E4F534A,
+		GLB_CHUNK_BIN = 0x004E4942,
+
+		COMPONENT_BYTE = 5120,
+		COMPONENT_UNSIGNED_BYTE = 5121,
+		COMPONENT_UNSIGNED_SHORT = 5123,
+		COMPONENT_UNSIGNED_INT = 5125,
+		COMPONENT_FLOAT = 5126,
+
+		TARGET_NONE = 0,
+		TARGET_ARRAY_BUFFER = 34962,
+		TARGET_ELEMENT_ARRAY_BUFFER = 34963
+	};
+
+	bool mQuantize = 0;
+	bool mUsesQuantization = 0;
+	std::vector<u8> mBuffer;
+	std::vector<u8> mBin;
+	std::string mJson;
+	std::string mBufferViews;
+	std::string mAccessors;
+	u32 mNumBufferViews = 0;
+	u32 mNumAccessors = 0;
+
+	//--------------------------------------------------
+	//	JSON
+	//--------------------------------------------------
+
+	static void AppendFormat(std::string& out, const char* format, ...)
+	{
+		char buffer[512];
+
+		va_list args;
+		va_start(args, format);
+		int length = vsnprintf(buffer, sizeof(buffer), format, args);
+		va_end(args);
+
+		if (length > 0) {
+			out.append(buffer, (static_cast<size_t>(length) < sizeof(buffer) ? static_cast<size_t>(length) : sizeof(buffer) - 1));
+		}
+	}
+
+	static void AppendString(std::string& out, const char* str)
+	{
+		out.push_back('"');
+
+		for (; *str; ++str)
+		{
+			char c = *str;
+			if (c == '"' || c == '\\')
+			{
+				out.push_back('\\');
+				out.push_back(c);
+			}
+			else if (0x20 > static_cast<u8>(c)) {
+				AppendFormat(out, "\\u%04X", static_cast<u32>(c));
+			}
+			else {
+				out.push_back(c);
+			}
+		}
+
+		out.push_back('"');
+	}
+
+	// Relative image uri next to the .glb, TextureManager hands out paths inside the output folder.
+	static void AppendUri(std::string& out, const std::string& filename)
+	{
+		size_t slash = filename.find_last_of("\\/");
+		const char* name = filename.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+
+		std::string uri;
+		for (; *name; ++name)
+		{
+			u8 c = static_cast<u8>(*name);
+			if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+				uri.push_back(static_cast<char>(c));
+			}
+			else {
+				AppendFormat(uri, "%%%02X", static_cast<u32>(c));
+			}
+		}
+
+		AppendString(out, uri.c_str());
+	}
+
+	static void AppendSeparator(std::string& out)
+	{
+		if (!out.empty()) {
+			out.push_back(',');
+		}
+	}
+
+	static void AppendFloats(std::string& out, const double* values, int count)
+	{
+		out.push_back('[');
+		for (int i = 0; count > i; ++i) {
+			AppendFormat(out, (i ? ",%.9g" : "%.9g"), values[i]);
+		}
+		out.push_back(']');
+	}
+
+	//--------------------------------------------------
+	//	Buffers
+	//--------------------------------------------------
+
+	// Appends a 4 byte aligned buffer view and returns where its data should be written.
+	u8* AddBufferView(size_t size, u32 target, u32& view, u32 stride = 0)
+	{
+		mBin.resize((mBin.size() + 3) & ~static_cast<size_t>(3));
+
+		size_t offset = mBin.size();
+		mBin.resize(offset + size);
+
+		AppendSeparator(mBufferViews);
+		AppendFormat(mBufferViews, "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu", offset, size);
+		if (stride) {
+			AppendFormat(mBufferViews, ",\"byteStride\":%u", stride);
+		}
+		if (target) {
+			AppendFormat(mBufferViews, ",\"target\":%u", target);
+		}
+		mBufferViews.push_back('}');
+
+		view = mNumBufferViews++;
+		return &mBin[offset];
+	}
+
+	u32 AddAccessor(u32 view, u32 component_type, u32 count, const char* type, bool normalized = 0, const double* min = 0, const double* max = 0, int num_bounds = 0)
+	{
+		AppendSeparator(mAccessors);
+		AppendFormat(mAccessors, "{\"bufferView\":%u,\"componentType\":%u,\"count\":%u,\"type\":\"%s\"", view, component_type, count, type);
+
+		if (normalized) {
+			mAccessors += ",\"normalized\":true";
+		}
+
+		if (min && max)
+		{
+			mAccessors += ",\"min\":";
+			AppendFloats(mAccessors, min, num_bounds);
+			mAccessors += ",\"max\":";
+			AppendFloats(mAccessors, max, num_bounds);
+		}
+
+		mAccessors.push_back('}');
+		return mNumAccessors++;
+	}
+
+	//--------------------------------------------------
+	//	Vertex Streams
+	//--------------------------------------------------
+
+	u32 WritePositions(const qModelMesh& mesh)
+	{
+		u32 view;
+		auto out = reinterpret_cast<f32*>(AddBufferView(sizeof(f32) * 3 * mesh.mNumVertices, TARGET_ARRAY_BUFFER, view));
+
+		double min[3] = { mesh.mPositions[0], mesh.mPositions[1], mesh.mPositions[2] };
+		double max[3] = { min[0], min[1], min[2] };
+
+		for (u32 v = 0; mesh.mNumVertices > v; ++v)
+		{
+			auto position = &mesh.mPositions[v * 4];
+
+			for (int c = 0; 3 > c; ++c)
+			{
+				f32 value = static_cast<f32>(position[c]);
+				out[v * 3 + c] = value;
+
+				min[c] = (min[c] > value ? value : min[c]);
+				max[c] = (value > max[c] ? value : max[c]);
+			}
+		}
+
+		return AddAccessor(view, COMPONENT_FLOAT, mesh.mNumVertices, "VEC3", 0, min, max, 3);
+	}
+
+	// BYTE4N normals are only roughly unit length, glTF requires normalized ones.
+	static void NormalizeNormal(const double* normal, double* out)
+	{
+		double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (1e-8 >= length)
+		{
+			out[0] = out[1] = 0.0;
+			out[2] = 1.0;
+			return;
+		}
+
+		for (int c = 0; 3 > c; ++c) {
+			out[c] = normal[c] / length;
+		}
+	}
+
+	u32 WriteNormals(const qModelMesh& mesh)
+	{
+		u32 view;
+		double normal[3];
+
+		if (mQuantize)
+		{
+			// Signed normalized bytes, padded to 4 bytes per vertex (attribute alignment).
+			auto out = reinterpret_cast<int8_t*>(AddBufferView(sizeof(int8_t) * 4 * mesh.mNumVertices, TARGET_ARRAY_BUFFER, view, 4));
+
+			for (u32 v = 0; mesh.mNumVertices > v; ++v)
+			{
+				NormalizeNormal(&mesh.mNormals[v * 4], normal);
+
+				for (int c = 0; 3 > c; ++c) {
+					out[v * 4 + c] = static_cast<int8_t>(lround(normal[c] * 127.0));
+				}
+				out[v * 4 + 3] = 0;
+			}
+
+			mUsesQuantization = 1;
+			return AddAccessor(view, COMPONENT_BYTE, mesh.mNumVertices, "VEC3", 1);
+		}
+
+		auto out = reinterpret_cast<f32*>(AddBufferView(sizeof(f32) * 3 * mesh.mNumVertices, TARGET_ARRAY_BUFFER, view));
+
+		for (u32 v = 0; mesh.mNumVertices > v; ++v)
+		{
+			NormalizeNormal(&mesh.mNormals[v * 4], normal);
+
+			for (int c = 0; 3 > c; ++c) {
+				out[v * 3 + c] = static_cast<f32>(normal[c]);
+			}
+		}
+
+		return AddAccessor(view, COMPONENT_FLOAT, mesh.mNumVertices, "VEC3");
+	}
+
+	u32 WriteTexCoords(const qModelMesh& mesh)
+	{
+		u32 view;
+
+		// HALF2 has no glTF equivalent, unsigned normalized shorts keep more precision when everything is in [0, 1].
+		if (mQuantize)
+		{
+			bool in_range = 1;
+			for (double uv : mesh.mUVs) {
+				in_range &= (uv >= 0.0 && 1.0 >= uv);
+			}
+
+			if (in_range)
+			{
+				auto out = reinterpret_cast<u16*>(AddBufferView(sizeof(u16) * 2 * mesh.mNumVertices, TARGET_ARRAY_BUFFER, view));
+
+				for (u32 v = 0; mesh.mNumVertices > v; ++v)
+				{
+					out[v * 2 + 0] = static_cast<u16>(lround(mesh.mUVs[v * 2 + 0] * 65535.0));
+					out[v * 2 + 1] = static_cast<u16>(lround((1.0 - mesh.mUVs[v * 2 + 1]) * 65535.0));
+				}
+
+				return AddAccessor(view, COMPONENT_UNSIGNED_SHORT, mesh.mNumVertices, "VEC2", 1);
+			}
+		}
+
+		auto out = reinterpret_cast<f32*>(AddBufferView(sizeof(f32) * 2 * mesh.mNumVertices, TARGET_ARRAY_BUFFER, view));
+
+		// Staged v is flipped for FBX (bottom-left origin), glTF uses top-left like the source data.
+		for (u32 v = 0; mesh.mNumVertices > v; ++v)
+		{
+			out[v * 2 + 0] = static_cast<f32>(mesh.mUVs[v * 2 + 0]);
+			out[v * 2 + 1] = static_cast<f32>(1.0 - mesh.mUVs[v * 2 + 1]);
+		}
+
+		return AddAccessor(view, COMPONENT_FLOAT, mesh.mNumVertices, "VEC2");
+	}
+
+	// Clusters (bone -> vertices) back to 4 joints & weights per vertex, joint index is the bone index.
+	void WriteSkinWeights(const qModelData& data, const qModelMesh& mesh, u32& joints_accessor, u32& weights_accessor)
+	{
+		const u32 num_vertices = mesh.mNumVertices;
+
+		std::vector<u16> joints(static_cast<size_t>(num_vertices) * 4, 0);
+		std::vector<f32> weights(static_cast<size_t>(num_vertices) * 4, 0.f);
+		std::vector<u8> numInfluences(num_vertices, 0);
+
+		for (auto& cluster : mesh.mClusters)
+		{
+			if (0 > cluster.mBone) {
+				continue;
+			}
+
+			for (size_t i = 0; cluster.mIndices.size() > i; ++i)
+			{
+				u32 v = static_cast<u32>(cluster.mIndices[i]);
+				if (v >= num_vertices || numInfluences[v] >= 4) {
+					continue;
+				}
+
+				u32 slot = v * 4 + numInfluences[v]++;
+				joints[slot] = static_cast<u16>(cluster.mBone);
+				weights[slot] = static_cast<f32>(cluster.mWeights[i]);
+			}
+		}
+
+		for (u32 v = 0; num_vertices > v; ++v)
+		{
+			auto vertexWeights = &weights[v * 4];
+
+			f32 sum = vertexWeights[0] + vertexWeights[1] + vertexWeights[2] + vertexWeights[3];
+			if (0.f >= sum)
+			{
+				vertexWeights[0] = 1.f;
+				continue;
+			}
+
+			for (int i = 0; 4 > i; ++i) {
+				vertexWeights[i] /= sum;
+			}
+		}
+
+		u32 view;
+
+		if (256 >= data.mBones.size())
+		{
+			auto out = AddBufferView(sizeof(u8) * joints.size(), TARGET_ARRAY_BUFFER, view);
+			for (size_t i = 0; joints.size() > i; ++i) {
+				out[i] = static_cast<u8>(joints[i]);
+			}
+
+			joints_accessor = AddAccessor(view, COMPONENT_UNSIGNED_BYTE, num_vertices, "VEC4");
+		}
+		else
+		{
+			memcpy(AddBufferView(sizeof(u16) * joints.size(), TARGET_ARRAY_BUFFER, view), joints.data(), sizeof(u16) * joints.size());
+			joints_accessor = AddAccessor(view, COMPONENT_UNSIGNED_SHORT, num_vertices, "VEC4");
+		}
+
+		if (mQuantize)
+		{
+			// Same precision as the source u8 weights, the largest weight absorbs the rounding so each vertex sums to 255.
+			auto out = AddBufferView(sizeof(u8) * weights.size(), TARGET_ARRAY_BUFFER, view);
+
+			for (u32 v = 0; num_vertices > v; ++v)
+			{
+				auto vertexWeights = &weights[v * 4];
+				auto quantized = &out[v * 4];
+
+				int sum = 0;
+				int largest = 0;
+
+				for (int i = 0; 4 > i; ++i)
+				{
+					quantized[i] = static_cast<u8>(lroundf(vertexWeights[i] * 255.f));
+					sum += quantized[i];
+					largest = (vertexWeights[i] > vertexWeights[largest] ? i : largest);
+				}
+
+				quantized[largest] = static_cast<u8>(quantized[largest] + (255 - sum));
+			}
+
+			weights_accessor = AddAccessor(view, COMPONENT_UNSIGNED_BYTE, num_vertices, "VEC4", 1);
+			return;
+		}
+
+		memcpy(AddBufferView(sizeof(f32) * weights.size(), TARGET_ARRAY_BUFFER, view), weights.data(), sizeof(f32) * weights.size());
+		weights_accessor = AddAccessor(view, COMPONENT_FLOAT, num_vertices, "VEC4");
+	}
+
+	u32 WriteIndices(const qModelMesh& mesh)
+	{
+		u32 view;
+		const u32 num_indices = static_cast<u32>(mesh.mIndices.size());
+
+		// 0xFFFF is the primitive restart value and can't be used as an index.
+		if (0xFFFF >= mesh.mNumVertices)
+		{
+			auto out = reinterpret_cast<u16*>(AddBufferView(sizeof(u16) * num_indices, TARGET_ELEMENT_ARRAY_BUFFER, view));
+			for (u32 i = 0; num_indices > i; ++i) {
+				out[i] = static_cast<u16>(mesh.mIndices[i]);
+			}
+
+			return AddAccessor(view, COMPONENT_UNSIGNED_SHORT, num_indices, "SCALAR");
+		}
+
+		memcpy(AddBufferView(sizeof(u32) * mesh.mIndices.size(), TARGET_ELEMENT_ARRAY_BUFFER, view), mesh.mIndices.data(), sizeof(u32) * mesh.mIndices.size());
+
+		return AddAccessor(view, COMPONENT_UNSIGNED_INT, static_cast<u32>(mesh.mIndices.size()), "SCALAR");
+	}
+
+	u32 WriteInverseBindMatrices(const qModelData& data)
+	{
+		std::vector<qModelMatrix> boneMatrices;
+		data.GetBoneMatrices(boneMatrices);
+
+		u32 view;
+		auto out = reinterpret_cast<f32*>(AddBufferView(sizeof(f32) * 16 * boneMatrices.size(), TARGET_NONE, view));
+
+		for (size_t i = 0; boneMatrices.size() > i; ++i)
+		{
+			qModelMatrix inverse = boneMatrices[i].InverseAffine();
+
+			for (int e = 0; 16 > e; ++e) {
+				out[i * 16 + e] = static_cast<f32>(inverse.m[e]);
+			}
+		}
+
+		return AddAccessor(view, COMPONENT_FLOAT, static_cast<u32>(boneMatrices.size()), "MAT4");
+	}
+
+	//--------------------------------------------------
+	//	Write
+	//--------------------------------------------------
+
+	const char* GetExtension() const override { return "glb"; }
+
+	bool Write(const qModelData& data, const char* filename) override
+	{
+		mBin.clear();
+		mBufferViews.clear();
+		mAccessors.clear();
+		mNumBufferViews = 0;
+		mNumAccessors = 0;
+		mUsesQuantization = 0;
+
+		std::string nodes;
+		std::string meshes;
+		std::string materials;
+		std::string textures;
+		std::string images;
+		std::string sceneNodes;
+
+		std::unordered_map<u32, u32> materialIndices;
+		std::unordered_map<u32, u32> textureIndices;
+
+		bool skinned = 0;
+		for (auto& mesh : data.mMeshes) {
+			skinned |= !mesh.mClusters.empty();
+		}
+		skinned &= data.IsSkinned();
+
+		// Skeleton
+
+		std::vector<std::vector<u32>> boneChildren(data.mBones.size());
+
+		for (size_t i = 0; data.mBones.size() > i; ++i)
+		{
+			int parent = data.mBones[i].mParent;
+
+			if (0 > parent)
+			{
+				AppendSeparator(sceneNodes);
+				AppendFormat(sceneNodes, "%u", static_cast<u32>(i));
+			}
+			else {
+				boneChildren[parent].push_back(static_cast<u32>(i));
+			}
+		}
+
+		for (size_t i = 0; data.mBones.size() > i; ++i)
+		{
+			auto& bone = data.mBones[i];
+
+			AppendSeparator(nodes);
+			nodes += "{\"name\":";
+			AppendString(nodes, bone.mName.c_str());
+			nodes += ",\"translation\":";
+			AppendFloats(nodes, bone.mTranslation, 3);
+			nodes += ",\"rotation\":";
+			AppendFloats(nodes, bone.mRotation, 4);
+			nodes += ",\"scale\":";
+			AppendFloats(nodes, bone.mScale, 3);
+
+			if (!boneChildren[i].empty())
+			{
+				nodes += ",\"children\":[";
+				for (size_t c = 0; boneChildren[i].size() > c; ++c) {
+					AppendFormat(nodes, (c ? ",%u" : "%u"), boneChildren[i][c]);
+				}
+				nodes.push_back(']');
+			}
+
+			nodes.push_back('}');
+		}
+
+		// Meshes
+
+		u32 num_meshes = 0;
+		u32 node_index = static_cast<u32>(data.mBones.size());
+
+		for (auto& mesh : data.mMeshes)
+		{
+			if (!mesh.mNumVertices || mesh.mIndices.empty()) {
+				continue;
+			}
+
+			// Material (one per Illusion::Material, diffuse & bump params become its textures)
+
+			int material_index = -1;
+
+			if (!mesh.mMaterials.empty())
+			{
+				auto result = materialIndices.emplace(mesh.mMaterials[0].mMaterialUID, static_cast<u32>(materialIndices.size()));
+				material_index = static_cast<int>(result.first->second);
+
+				if (result.second)
+				{
+					AppendSeparator(materials);
+					materials += "{\"name\":";
+					AppendString(materials, mesh.mMaterials[0].mName.c_str());
+
+					std::string diffuse;
+					std::string bump;
+
+					for (auto& material : mesh.mMaterials)
+					{
+						auto texture = textureIndices.emplace(material.mTextureUID, static_cast<u32>(textureIndices.size()));
+						if (texture.second)
+						{
+							AppendSeparator(images);
+							images += "{\"uri\":";
+							AppendUri(images, material.mTextureFilename);
+							images += ",\"mimeType\":\"image/vnd-ms.dds\"}";
+
+							AppendSeparator(textures);
+							AppendFormat(textures, "{\"extensions\":{\"MSFT_texture_dds\":{\"source\":%u}}}", texture.first->second);
+						}
+
+						auto& target = (material.mType == qModelMaterial::TYPE_DIFFUSE ? diffuse : bump);
+						if (target.empty()) {
+							AppendFormat(target, "{\"index\":%u}", texture.first->second);
+						}
+					}
+
+					materials += ",\"pbrMetallicRoughness\":{\"metallicFactor\":0";
+					if (!diffuse.empty()) {
+						materials += ",\"baseColorTexture\":" + diffuse;
+					}
+					materials.push_back('}');
+
+					if (!bump.empty()) {
+						materials += ",\"normalTexture\":" + bump;
+					}
+
+					materials.push_back('}');
+				}
+			}
+
+			// Primitive
+
+			std::string attributes;
+			AppendFormat(attributes, "\"POSITION\":%u", WritePositions(mesh));
+
+			if (!mesh.mNormals.empty()) {
+				AppendFormat(attributes, ",\"NORMAL\":%u", WriteNormals(mesh));
+			}
+
+			if (!mesh.mUVs.empty()) {
+				AppendFormat(attributes, ",\"TEXCOORD_0\":%u", WriteTexCoords(mesh));
+			}
+
+			const bool mesh_skinned = (skinned && !mesh.mClusters.empty());
+			if (mesh_skinned)
+			{
+				u32 joints_accessor, weights_accessor;
+				WriteSkinWeights(data, mesh, joints_accessor, weights_accessor);
+				AppendFormat(attributes, ",\"JOINTS_0\":%u,\"WEIGHTS_0\":%u", joints_accessor, weights_accessor);
+			}
+
+			u32 indices_accessor = WriteIndices(mesh);
+
+			AppendSeparator(meshes);
+			meshes += "{\"name\":";
+			AppendString(meshes, mesh.mName.c_str());
+			AppendFormat(meshes, ",\"primitives\":[{\"attributes\":{%s},\"indices\":%u", attributes.c_str(), indices_accessor);
+			if (material_index >= 0) {
+				AppendFormat(meshes, ",\"material\":%i", material_index);
+			}
+			meshes += "}]}";
+
+			AppendSeparator(nodes);
+			nodes += "{\"name\":";
+			AppendString(nodes, mesh.mName.c_str());
+			AppendFormat(nodes, ",\"mesh\":%u", num_meshes++);
+			if (mesh_skinned) {
+				nodes += ",\"skin\":0";
+			}
+			nodes.push_back('}');
+
+			AppendSeparator(sceneNodes);
+			AppendFormat(sceneNodes, "%u", node_index++);
+		}
+
+		// Document
+
+		mJson.clear();
+		mJson += "{\"asset\":{\"version\":\"2.0\",\"generator\":\"PermToFBX\"}";
+
+		std::string extensions;
+		if (!textures.empty())
+		{
+			AppendSeparator(extensions);
+			extensions += "\"MSFT_texture_dds\"";
+		}
+		if (mUsesQuantization)
+		{
+			AppendSeparator(extensions);
+			extensions += "\"KHR_mesh_quantization\"";
+		}
+
+		if (!extensions.empty()) {
+			mJson += ",\"extensionsUsed\":[" + extensions + "]";
+		}
+
+		if (mUsesQuantization) {
+			mJson += ",\"extensionsRequired\":[\"KHR_mesh_quantization\"]";
+		}
+
+		mJson += ",\"scene\":0,\"scenes\":[{\"name\":";
+		AppendString(mJson, data.mName.c_str());
+		mJson += ",\"nodes\":[" + sceneNodes + "]}]";
+
+		if (!nodes.empty()) {
+			mJson += ",\"nodes\":[" + nodes + "]";
+		}
+
+		if (!meshes.empty()) {
+			mJson += ",\"meshes\":[" + meshes + "]";
+		}
+
+		if (skinned)
+		{
+			u32 inverse_bind_matrices = WriteInverseBindMatrices(data);
+
+			mJson += ",\"skins\":[{\"name\":";
+			AppendString(mJson, data.mSkinName.c_str());
+			AppendFormat(mJson, ",\"inverseBindMatrices\":%u,\"joints\":[", inverse_bind_matrices);
+			for (size_t i = 0; data.mBones.size() > i; ++i) {
+				AppendFormat(mJson, (i ? ",%u" : "%u"), static_cast<u32>(i));
+			}
+			mJson += "]}]";
+		}
+
+		if (!materials.empty()) {
+			mJson += ",\"materials\":[" + materials + "]";
+		}
+
+		if (!textures.empty())
+		{
+			mJson += ",\"textures\":[" + textures + "]";
+			mJson += ",\"images\":[" + images + "]";
+		}
+
+		if (!mBin.empty())
+		{
+			mBin.resize((mBin.size() + 3) & ~static_cast<size_t>(3));
+
+			mJson += ",\"accessors\":[" + mAccessors + "]";
+			mJson += ",\"bufferViews\":[" + mBufferViews + "]";
+			AppendFormat(mJson, ",\"buffers\":[{\"byteLength\":%zu}]", mBin.size());
+		}
+
+		mJson.push_back('}');
+		mJson.resize((mJson.size() + 3) & ~static_cast<size_t>(3), ' ');
+
+		// Container
+
+		const u32 json_size = static_cast<u32>(mJson.size());
+		const u32 bin_size = static_cast<u32>(mBin.size());
+		const u32 total_size = 12 + 8 + json_size + (bin_size ? 8 + bin_size : 0);
+
+		mBuffer.clear();
+		mBuffer.reserve(total_size);
+
+		auto append = [this](const void* src, size_t size)
+		{
+			auto bytes = static_cast<const u8*>(src);
+			mBuffer.insert(mBuffer.end(), bytes, &bytes[size]);
+		};
+
+		const u32 header[] = { GLB_MAGIC, GLB_VERSION, total_size, json_size, GLB_CHUNK_JSON };
+		append(header, sizeof(header));
+		append(mJson.data(), json_size);
+
+		if (bin_size)
+		{
+			const u32 chunk[] = { bin_size, GLB_CHUNK_BIN };
+			append(chunk, sizeof(chunk));
+			append(mBin.data(), bin_size);
+		}
+
+		FILE* file = fopen(filename, "wb");
+		if (!file) {
+			return 0;
+		}
+
+		bool written = (fwrite(mBuffer.data(), 1, mBuffer.size(), file) == mBuffer.size());
+		fclose(file);
+
+		return written;
+	}
+};
\ No newline at end of file
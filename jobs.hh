@@ -0,0 +1,327 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobs
+{
+	u32 GetHardwareThreads()
+	{
+		u32 num_threads = std::thread::hardware_concurrency();
+		return (num_threads ? num_threads : 1);
+	}
+
+	// Calls func(index, worker) for every index in [0, count) on up to num_workers threads.
+	// Indices are handed out dynamically so uneven work (e.g. big vs small models) balances itself.
+	template <typename Func>
+	void ParallelFor(u32 count, u32 num_workers, Func func)
+	{
+		if (num_workers > count) {
+			num_workers = count;
+		}
+
+		if (1 >= num_workers)
+		{
+			for (u32 i = 0; count > i; ++i) {
+				func(i, 0);
+			}
+			return;
+		}
+
+		std::atomic<u32> next(0);
+		std::vector<std::thread> threads;
+		threads.reserve(num_workers);
+
+		for (u32 w = 0; num_workers > w; ++w)
+		{
+			threads.emplace_back([&, w]()
+			{
+				for (u32 i = next.fetch_add(1); count > i; i = next.fetch_add(1)) {
+					func(i, w);
+				}
+			});
+		}
+
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	// Fixed set of threads consuming a bounded FIFO, Push blocks while the queue is full.
+	class TaskPool
+	{
+	public:
+		std::vector<std::thread> mThreads;
+		std::deque<std::function<void()>> mTasks;
+		std::mutex mMutex;
+		std::condition_variable mTaskAdded;
+		std::condition_variable mTaskRemoved;
+		std::condition_variable mIdle;
+		size_t mMaxTasks = 0;
+		u32 mNumBusy = 0;
+		bool mStop = 0;
+
+		~TaskPool()
+		{
+			Stop();
+		}
+
+		void Start(u32 num_threads, size_t max_tasks)
+		{
+			mMaxTasks = (max_tasks ? max_tasks : 1);
+			mStop = 0;
+
+			for (u32 i = 0; num_threads > i; ++i) {
+				mThreads.emplace_back([this]() { Run(); });
+			}
+		}
+
+		void Push(std::function<void()> task)
+		{
+			if (mThreads.empty())
+			{
+				task();
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(mMutex);
+			mTaskRemoved.wait(lock, [this]() { return mMaxTasks > mTasks.size(); });
+
+			mTasks.push_back(std::move(task));
+			mTaskAdded.notify_one();
+		}
+
+		// Blocks until every pushed task has finished.
+		void Wait()
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mIdle.wait(lock, [this]() { return mTasks.empty() && !mNumBusy; });
+		}
+
+		void Stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStop = 1;
+			}
+			mTaskAdded.notify_all();
+
+			for (auto& thread : mThreads) {
+				thread.join();
+			}
+
+			mThreads.clear();
+		}
+
+		void Run()
+		{
+			for (;;)
+			{
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(mMutex);
+					mTaskAdded.wait(lock, [this]() { return mStop || !mTasks.empty(); });
+
+					if (mTasks.empty()) {
+						return;
+					}
+
+					task = std::move(mTasks.front());
+					mTasks.pop_front();
+					++mNumBusy;
+				}
+				mTaskRemoved.notify_one();
+
+				task();
+
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					--mNumBusy;
+				}
+				mIdle.notify_all();
+			}
+		}
+	};
+
+	// Threads with one deque each, a worker runs its own newest task first (LIFO) and steals the oldest task of another worker when it runs dry.
+	// The thread calling ParallelFor helps until its tasks are done, so nested use from a worker can't deadlock.
+	class WorkStealingPool
+	{
+	public:
+		struct Queue
+		{
+			std::mutex mMutex;
+			std::deque<std::function<void()>> mTasks;
+		};
+
+		std::vector<std::thread> mThreads;
+		std::vector<std::unique_ptr<Queue>> mQueues;
+		std::atomic<u32> mNumQueued;
+		std::atomic<u32> mNextQueue;
+		std::mutex mMutex;
+		std::condition_variable mTaskAdded;
+		bool mStop = 0;
+
+		static u32& GetWorkerIndex()
+		{
+			static thread_local u32 worker_index = ~0u;
+			return worker_index;
+		}
+
+		WorkStealingPool() : mNumQueued(0), mNextQueue(0) {}
+
+		~WorkStealingPool()
+		{
+			Stop();
+		}
+
+		void Start(u32 num_threads)
+		{
+			mStop = 0;
+
+			for (u32 i = 0; num_threads > i; ++i) {
+				mQueues.emplace_back(new Queue);
+			}
+
+			for (u32 i = 0; num_threads > i; ++i)
+			{
+				mThreads.emplace_back([this, i]()
+				{
+					GetWorkerIndex() = i;
+					Run(i);
+				});
+			}
+		}
+
+		void Stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStop = 1;
+			}
+			mTaskAdded.notify_all();
+
+			for (auto& thread : mThreads) {
+				thread.join();
+			}
+
+			mThreads.clear();
+			mQueues.clear();
+		}
+
+		// Workers push to their own deque, other threads spread tasks round robin.
+		void Push(std::function<void()> task)
+		{
+			u32 queue_index = GetWorkerIndex();
+			if (queue_index >= mQueues.size()) {
+				queue_index = mNextQueue.fetch_add(1) % static_cast<u32>(mQueues.size());
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				++mNumQueued;
+			}
+
+			{
+				auto& queue = *mQueues[queue_index];
+				std::lock_guard<std::mutex> lock(queue.mMutex);
+				queue.mTasks.push_back(std::move(task));
+			}
+			mTaskAdded.notify_one();
+		}
+
+		// Own deque from the back, then the front of every other deque.
+		bool TryRunTask(u32 queue_index)
+		{
+			std::function<void()> task;
+			const u32 num_queues = static_cast<u32>(mQueues.size());
+
+			if (num_queues > queue_index)
+			{
+				auto& queue = *mQueues[queue_index];
+				std::lock_guard<std::mutex> lock(queue.mMutex);
+
+				if (!queue.mTasks.empty())
+				{
+					task = std::move(queue.mTasks.back());
+					queue.mTasks.pop_back();
+				}
+			}
+
+			for (u32 i = 1; !task && num_queues >= i; ++i)
+			{
+				auto& queue = *mQueues[(queue_index + i) % num_queues];
+				std::lock_guard<std::mutex> lock(queue.mMutex);
+
+				if (!queue.mTasks.empty())
+				{
+					task = std::move(queue.mTasks.front());
+					queue.mTasks.pop_front();
+				}
+			}
+
+			if (!task) {
+				return 0;
+			}
+
+			--mNumQueued;
+			task();
+			return 1;
+		}
+
+		void Run(u32 queue_index)
+		{
+			for (;;)
+			{
+				if (TryRunTask(queue_index)) {
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(mMutex);
+				mTaskAdded.wait(lock, [this]() { return mStop || mNumQueued.load(); });
+
+				if (mStop) {
+					return;
+				}
+			}
+		}
+
+		// Calls func(index) for every index in [0, count) and returns once all of them finished.
+		template <typename Func>
+		void ParallelFor(u32 count, Func func)
+		{
+			if (1 >= count || mThreads.empty())
+			{
+				for (u32 i = 0; count > i; ++i) {
+					func(i);
+				}
+				return;
+			}
+
+			std::atomic<u32> remaining(count);
+
+			for (u32 i = 0; count > i; ++i)
+			{
+				Push([&, i]()
+				{
+					func(i);
+					--remaining;
+				});
+			}
+
+			const u32 queue_index = GetWorkerIndex();
+
+			while (remaining.load())
+			{
+				if (!TryRunTask(queue_index)) {
+					std::this_thread::yield();
+				}
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -6,29 +6,52 @@
 
 using namespace UFG;
 
+#include "platform.hh"
+#include "resindex.hh"
 #include "core.hh"
+#include "profile.hh"
+#include "jobs.hh"
+#include "vertexdecode.hh"
 #include "texmgr.hh"
+#include "filescan.hh"
+#include "fileloader.hh"
+#include "manifest.hh"
+
+#include "modeldata.hh"
+#include "rigindex.hh"
 
 //--------------------------------------------------
 //	FBX SDK
 //--------------------------------------------------
 
-#include <fbxsdk.h> // 2020.3.7
-#ifdef _DEBUG
-	#pragma comment(lib, "libfbxsdk-md.lib")
-	#pragma comment(lib, "libxml2-md.lib")
-	#pragma comment(lib, "zlib-md.lib")
-#else
-	#pragma comment(lib, "libfbxsdk-mt.lib")
-	#pragma comment(lib, "libxml2-mt.lib")
-	#pragma comment(lib, "zlib-mt.lib")
+// Define PERMTOFBX_NO_FBXSDK to build without the SDK, only the native writers (-format=fbx-native, glb) are available then.
+// MSVC links through the pragmas below, other compilers get zlib from CMakeLists.txt (SDK-less builds only).
+#ifndef PERMTOFBX_NO_FBXSDK
+	#include <fbxsdk.h> // 2020.3.7
+	#ifdef _MSC_VER
+		#ifdef _DEBUG
+			#pragma comment(lib, "libfbxsdk-md.lib")
+			#pragma comment(lib, "libxml2-md.lib")
+			#pragma comment(lib, "zlib-md.lib")
+		#else
+			#pragma comment(lib, "libfbxsdk-mt.lib")
+			#pragma comment(lib, "libxml2-mt.lib")
+			#pragma comment(lib, "zlib-mt.lib")
+		#endif
+	#endif
+#elif defined(_MSC_VER)
+	#pragma comment(lib, "zlib.lib")
 #endif
 
 //--------------------------------------------------
-//	FBX Model
+//	Output Backends
 //--------------------------------------------------
 
-#include "fbxmodel.hh"
+#ifndef PERMTOFBX_NO_FBXSDK
+	#include "fbxmodel.hh"
+#endif
+#include "fbxwriter.hh"
+#include "gltfwriter.hh"
 
 //--------------------------------------------------
 //	Inventories
@@ -41,305 +64,562 @@ qResourceInventory gBufferInventory = { "BufferInventory", RTypeUID_Buffer, Chun
 qResourceInventory gBonePaletteInventory = { "BonePaletteInventory", RTypeUID_BonePalette, ChunkUID_BonePalette };
 qResourceInventory gRigResourceInventory = { "RigResourceInventory", RTypeUID_RigResource, ChunkUID_RigResource };
 
+// Meshes of one model are decoded in parallel on the cores left over by -jobs.
+jobs::WorkStealingPool gMeshPool;
+
 //--------------------------------------------------
 //	Export Logic
 //--------------------------------------------------
 
-void ExportModel(const char* output_path, fbxsdk::FbxManager* mgr, Illusion::Model* mdl, UFG::RigResource* rig)
+// Decodes one mesh of the model into its own staging (positions, normals, texcoords, indices, material & clusters).
+bool BuildMeshData(const char* output_path, Illusion::Model* mdl, u32 m, const std::vector<int>* paletteBones, core::LogBuffer& log, qModelMesh& modelMesh)
 {
-	qPrintf("[ INFO ] Exporting: %s\n", mdl->mDebugName);
+	auto mesh = mdl->GetMesh(m);
 
-	auto warehouse = qResourceWarehouse::Instance();
+	auto qPrintPrefix = [&](const char* prefix, const char* str) { log.Printf("[ %s ] Mesh %s (Index %u) %s", prefix, mdl->mDebugName, m, str); };
 
-	auto fbxModel = qFBXModel(mgr);
-	fbxsdk::FbxSkin* fbxSkin = 0;
-	fbxsdk::FbxArray<fbxsdk::FbxNode*> fbxBoneNodes;
+	auto vertexStreamDesc = core::GetVertexStreamDescriptor(mesh->mVertexDeclHandle.mNameUID);
+	if (!vertexStreamDesc)
+	{
+		qPrintPrefix("ERROR", " missing vertex stream descriptor!\n");
+		return 0;
+	}
 
-	auto bonePalette = static_cast<Illusion::BonePalette*>(warehouse->DebugGet(RTypeUID_BonePalette, mdl->mBonePaletteHandle.mNameUID));
-	int num_bones = 0;
+	auto material = mesh->mMaterialHandle.GetData();
+	if (!material)
+	{
+		qPrintPrefix("ERROR", " missing material!\n");
+		return 0;
+	}
 
-	if (bonePalette && rig)
+	auto indexBuffer = mesh->mIndexBufferHandle.GetData();
+	if (!indexBuffer)
 	{
-		auto skeleton = rig->mSkeleton;
-		num_bones = skeleton->m_bones.m_size;
+		qPrintPrefix("ERROR", " missing index buffer!\n");
+		return 0;
+	}
 
-		if (bonePalette->mNumBones > static_cast<u32>(num_bones)) {
-			qPrintf("[ WARN ] %s (u) has more bones than skeleton in %s (i)\n", bonePalette->mDebugName, bonePalette->mNumBones, rig->mDebugName, num_bones);
-		}
-		else if (!core::ValidateBonesWithRig(rig, bonePalette)) {
-			qPrintf("[ WARN ] %s doesn't match skeleton bones in %s\n", bonePalette->mDebugName, rig->mDebugName);
-		}
-		else
-		{
-			for (int i = 0; num_bones > i; ++i)
-			{
-				auto bone = &skeleton->m_bones.m_data[i];
-				auto trans = &skeleton->m_referencePose.m_data[i];
-
-				fbxsdk::FbxAMatrix matrix;
-
-				matrix.SetT(fbxsdk::FbxVector4(
-					static_cast<double>(trans->m_translation.m_quad.m128_f32[0]),
-					static_cast<double>(trans->m_translation.m_quad.m128_f32[1]),
-					static_cast<double>(trans->m_translation.m_quad.m128_f32[2])
-				));
-
-				matrix.SetQ(fbxsdk::FbxQuaternion(
-					static_cast<double>(trans->m_rotation.m_vec.m_quad.m128_f32[0]),
-					static_cast<double>(trans->m_rotation.m_vec.m_quad.m128_f32[1]),
-					static_cast<double>(trans->m_rotation.m_vec.m_quad.m128_f32[2]),
-					static_cast<double>(trans->m_rotation.m_vec.m_quad.m128_f32[3])
-				));
-
-				matrix.SetS(fbxsdk::FbxVector4(
-					static_cast<double>(trans->m_scale.m_quad.m128_f32[0]),
-					static_cast<double>(trans->m_scale.m_quad.m128_f32[1]),
-					static_cast<double>(trans->m_scale.m_quad.m128_f32[2])
-				));
-
-				fbxBoneNodes.Add(fbxModel.CreateLimbNode(bone->m_name, matrix));
-			}
+	auto decodePlan = VertexDecode::GetPlan(vertexStreamDesc);
+	if (!decodePlan->mPosition.IsPresent())
+	{
+		qPrintPrefix("ERROR", " missing vertex position!\n");
+		return 0;
+	}
 
-			for (int i = 0; num_bones > i; ++i)
-			{
-				int parent = skeleton->m_parentIndices.m_data[i];
+	auto vertexBuffer = mesh->mVertexBufferHandles[decodePlan->mPosition.mStream].GetData();
+	if (!vertexBuffer)
+	{
+		qPrintPrefix("ERROR", " missing vertex buffer!\n");
+		return 0;
+	}
 
-				if (parent == -1) {
-					fbxModel.mScene->GetRootNode()->AddChild(fbxBoneNodes[i]);
-				}
-				else {
-					fbxBoneNodes[parent]->AddChild(fbxBoneNodes[i]);
-				}
-			}
+	core::MeshVertexRange vertexRange;
+	{
+		PROFILE_SCOPE("DecodeIndices");
 
-			fbxSkin = fbxModel.CreateSkin(bonePalette->mDebugName);
+		if (!core::BuildMeshVertexRange(mesh, indexBuffer, vertexBuffer->mNumElements, vertexRange))
+		{
+			qPrintPrefix("ERROR", " has invalid index buffer!\n");
+			return 0;
 		}
 	}
 
-	for (u32 m = 0; mdl->mNumMeshes > m; ++m)
-	{
-		auto mesh = mdl->GetMesh(m);
-		core::InitMeshHandles(mesh);
+	const u32 num_vertices = static_cast<u32>(vertexRange.mVertices.size());
+	auto vertices = vertexRange.mVertices.data();
 
-		auto qPrintPrefix = [&](const char* prefix, const char* str) { qPrintf("[ %s ] Mesh %s (Index %u) %s", prefix, mdl->mDebugName, m, str); };
+	// Highest referenced vertex (mVertices is ascending), elements whose stream buffer doesn't cover it are skipped.
+	const u32 last_vertex = (num_vertices ? vertices[num_vertices - 1] : 0);
 
-		auto vertexStreamDesc = core::GetVertexStreamDescriptor(mesh->mVertexDeclHandle.mNameUID);
-		if (!vertexStreamDesc)
-		{
-			qPrintPrefix("ERROR", " missing vertex stream descriptor!\n");
+	Profile::Add(Profile::COUNTER_VERTICES_DECODED, num_vertices);
+	Profile::Add(Profile::COUNTER_TRIANGLES_DECODED, vertexRange.mIndices.size() / 3);
+
+	qString meshName = { "%s.%u", mdl->mDebugName, m };
+	modelMesh.mName = meshName.mData;
+	modelMesh.mNumVertices = num_vertices;
+
+	// Material
+
+	for (u32 p = 0; material->mNumParams > p; ++p)
+	{
+		auto param = material->GetParam(p);
+		if (param->mNameUID != core::MATERIAL_PARAM_DIFFUSE_MAP && param->mNameUID != core::MATERIAL_PARAM_BUMP_MAP) {
 			continue;
 		}
 
-		auto material = mesh->mMaterialHandle.GetData();
-		if (!material)
-		{
-			qPrintPrefix("ERROR", " missing material!\n");
-			continue;
+		qModelMaterial modelMaterial;
+		modelMaterial.mName = material->mDebugName;
+		modelMaterial.mTextureFilename = TextureManager::FindTextureFile(output_path, param->mResourceHandle.mNameUID).mData;
+		modelMaterial.mMaterialUID = material->mNode.mUID;
+		modelMaterial.mTextureUID = param->mResourceHandle.mNameUID;
+		modelMaterial.mType = (param->mNameUID == core::MATERIAL_PARAM_DIFFUSE_MAP ? qModelMaterial::TYPE_DIFFUSE : qModelMaterial::TYPE_BUMP);
+
+		modelMesh.mMaterials.push_back(modelMaterial);
+	}
+
+	// Positions
+
+	{
+		PROFILE_SCOPE("DecodePositions");
+		auto& element = decodePlan->mPosition;
+
+		modelMesh.mPositions.resize(static_cast<size_t>(num_vertices) * 4);
+		if (auto element_data = element.GetData(mesh, last_vertex)) {
+			VertexDecode::DecodeVector4(element, element_data, vertices, num_vertices, modelMesh.mPositions.data(), 4, core::gAxisSystem);
 		}
+	}
 
-		auto indexBuffer = mesh->mIndexBufferHandle.GetData();
-		if (!indexBuffer)
-		{
-			qPrintPrefix("ERROR", " missing index buffer!\n");
-			continue;
+	// Normals
+
+	if (decodePlan->mNormal.IsPresent())
+	{
+		PROFILE_SCOPE("DecodeNormals");
+		auto& element = decodePlan->mNormal;
+
+		modelMesh.mNormals.resize(static_cast<size_t>(num_vertices) * 4);
+		if (auto element_data = element.GetData(mesh, last_vertex)) {
+			VertexDecode::DecodeVector4(element, element_data, vertices, num_vertices, modelMesh.mNormals.data(), 4, core::gAxisSystem);
 		}
+	}
 
-		auto vertex_position_stream = core::GetVertexStreamElement(vertexStreamDesc, Illusion::VERTEX_ELEMENT_POSITION);
-		auto vertexBuffer = mesh->mVertexBufferHandles[vertex_position_stream->mStream].GetData();
-		if (!vertexBuffer)
+	// Texture Coord
+
+	if (decodePlan->mTexCoord.IsPresent())
+	{
+		PROFILE_SCOPE("DecodeTexCoords");
+		auto& element = decodePlan->mTexCoord;
+
+		modelMesh.mUVs.resize(static_cast<size_t>(num_vertices) * 2);
+		if (auto element_data = element.GetData(mesh, last_vertex)) {
+			VertexDecode::DecodeTexCoord(element, element_data, vertices, num_vertices, modelMesh.mUVs.data(), 2);
+		}
+	}
+
+	// Polygons
+
+	modelMesh.mIndices = std::move(vertexRange.mIndices);
+
+	// Blend Indexes & Weights (Rig)
+
+	auto& index_element = decodePlan->mBlendIndex;
+	auto& weight_element = decodePlan->mBlendWeight;
+
+	if (index_element.IsValid() && weight_element.IsValid() && paletteBones && !paletteBones->empty())
+	{
+		PROFILE_SCOPE("DecodeSkin");
+
+		auto index_data = index_element.GetData(mesh, last_vertex);
+		auto weight_data = weight_element.GetData(mesh, last_vertex);
+
+		std::vector<u8> blendIndexes(num_vertices * 4);
+		std::vector<f32> blendWeights(num_vertices * 4);
+
+		if (index_data && weight_data)
 		{
-			qPrintPrefix("ERROR", " missing vertex buffer!\n");
-			continue;
+			VertexDecode::DecodeU8x4(index_element, index_data, vertices, num_vertices, blendIndexes.data());
+			VertexDecode::DecodeWeights(weight_element, weight_data, vertices, num_vertices, blendWeights.data());
 		}
 
-		qString meshName = { "%s.%u", mdl->mDebugName, m };
-		auto fbxMesh = fbxModel.CreateMesh(meshName, vertexBuffer->mNumElements);
-		auto fbxNode = fbxMesh->GetNode();
+		modelMesh.mClusters.resize(paletteBones->size());
 
-		auto fbxUV = fbxMesh->CreateElementUV("UV0");
-		fbxUV->SetMappingMode(fbxsdk::FbxGeometryElement::eByPolygonVertex);
-		fbxUV->SetReferenceMode(fbxsdk::FbxGeometryElement::eIndexToDirect);
+		for (size_t i = 0; paletteBones->size() > i; ++i) {
+			modelMesh.mClusters[i].mBone = (*paletteBones)[i];
+		}
 
-		// Material
-		for (u32 p = 0; material->mNumParams > p; ++p)
+		for (u32 v = 0; num_vertices > v; ++v)
 		{
-			auto param = material->GetParam(p);
-			if (param->mNameUID == 0xDCE06689)
-			{
-				qString filename = TextureManager::FindTextureFile(output_path, param->mResourceHandle.mNameUID);
-				auto fbxMat = fbxModel.CreateDiffuseMaterial(material->mDebugName, filename, fbxUV->GetName());
-				fbxNode->AddMaterial(fbxMat);
-			}
-			else if (param->mNameUID == 0xADBE1A5A)
+			auto indexes = &blendIndexes[v * 4];
+			auto weights = &blendWeights[v * 4];
+
+			for (int i = 0; 4 > i; ++i)
 			{
-				qString filename = TextureManager::FindTextureFile(output_path, param->mResourceHandle.mNameUID);
-				auto fbxMat = fbxModel.CreateBumpMaterial(material->mDebugName, filename, fbxUV->GetName());
-				fbxNode->AddMaterial(fbxMat);
+				u8 bone_index = indexes[i];
+				if (bone_index >= modelMesh.mClusters.size()) {
+					continue;
+				}
+
+				auto& cluster = modelMesh.mClusters[bone_index];
+				cluster.mIndices.push_back(static_cast<int>(v));
+				cluster.mWeights.push_back(static_cast<double>(weights[i]));
 			}
 		}
+	}
+
+	return 1;
+}
+
+// Decodes the model (skeleton, meshes, materials & skin) into backend independent arrays.
+// Meshes are appended, so models sharing a rig can be decoded into one scene (-combine=rig).
+void BuildModelData(const char* output_path, Illusion::Model* mdl, RigIndex::Rig* rig, core::LogBuffer& log, qModelData& data)
+{
+	PROFILE_SCOPE("BuildModel", mdl->mDebugName);
+
+	if (data.mName.empty()) {
+		data.mName = mdl->mDebugName;
+	}
+
+	auto bonePalette = static_cast<Illusion::BonePalette*>(ResourceIndex::Get(RTypeUID_BonePalette, mdl->mBonePaletteHandle.mNameUID));
+	const std::vector<int>* paletteBones = 0;
+
+	// -rig=auto (no fixed rig) picks the rig per bone palette.
+	if (bonePalette && !rig && !RigIndex::gRigs.empty())
+	{
+		rig = RigIndex::FindRig(bonePalette);
+
+		if (rig) {
+			log.Printf("[ INFO ] %s uses rig %s\n", bonePalette->mDebugName, rig->mResource->mDebugName);
+		}
+		else {
+			log.Printf("[ WARN ] No loaded rig matches %s\n", bonePalette->mDebugName);
+		}
+	}
 
-		// Positions
-		{
-			auto stream_element = vertex_position_stream;
+	if (bonePalette && rig)
+	{
+		auto& palette = rig->GetPalette(bonePalette);
 
-			auto cp = fbxMesh->GetControlPoints();
-			for (u32 v = 0; vertexBuffer->mNumElements > v; ++v)
+		switch (palette.mMatch)
+		{
+		case RigIndex::PALETTE_TOO_MANY_BONES:
+			log.Printf("[ WARN ] %s (%u) has more bones than skeleton in %s (%u)\n", bonePalette->mDebugName, bonePalette->mNumBones, rig->mResource->mDebugName, static_cast<u32>(rig->mBones.size()));
+			break;
+		case RigIndex::PALETTE_MISSING_BONES:
+			log.Printf("[ WARN ] %s doesn't match skeleton bones in %s\n", bonePalette->mDebugName, rig->mResource->mDebugName);
+			break;
+		case RigIndex::PALETTE_MATCH:
+		{
+			if (data.mBones.empty())
 			{
-				auto pos = static_cast<f32*>(core::GetVertexStreamData(vertexStreamDesc, stream_element, vertexBuffer, v));
-				cp[v] = fbxsdk::FbxVector4(static_cast<double>(pos[0]), static_cast<double>(pos[1]), static_cast<double>(pos[2]));
+				data.mSkinName = bonePalette->mDebugName;
+				data.mBones = rig->mBones;
 			}
+			paletteBones = &palette.mBones;
+		}
+		break;
 		}
+	}
 
-		// Normals
+	// Meshes are decoded on the mesh pool into their own staging & log, then appended in order.
 
-		if (auto stream_element = core::GetVertexStreamElement(vertexStreamDesc, Illusion::VERTEX_ELEMENT_NORMAL))
-		{
-			auto fbxNormal = fbxMesh->CreateElementNormal();
-			fbxNormal->SetMappingMode(FbxGeometryElement::eByControlPoint);
-			fbxNormal->SetReferenceMode(FbxGeometryElement::eDirect);
+	const u32 num_meshes = mdl->mNumMeshes;
 
-			auto normalBuffer = mesh->mVertexBufferHandles[stream_element->mStream].GetData();
+	std::vector<qModelMesh> meshes(num_meshes);
+	std::vector<core::LogBuffer> meshLogs(num_meshes);
+	std::vector<u8> meshBuilt(num_meshes, 0);
 
-			for (u32 v = 0; normalBuffer->mNumElements > v; ++v)
-			{
-				auto data = core::GetVertexStreamData(vertexStreamDesc, stream_element, normalBuffer, v);
-				fbxsdk::FbxVector4 normal = { 0.0, 0.0, 0.0, 1.0 };
-
-				for (int i = 0; 3 > i; ++i)
-				{
-					switch (stream_element->mType)
-					{
-					case Illusion::VERTEX_TYPE_FLOAT3:
-					case Illusion::VERTEX_TYPE_FLOAT4:
-						normal[i] = static_cast<double>(static_cast<f32*>(data)[i]); break;
-					case Illusion::VERTEX_TYPE_BYTE4N:
-						normal[i] = static_cast<double>(BYTE4N_FLT(static_cast<u8*>(data)[i])); break;
-					}
-					
-				}
+	gMeshPool.ParallelFor(num_meshes, [&](u32 m)
+	{
+		meshBuilt[m] = BuildMeshData(output_path, mdl, m, paletteBones, meshLogs[m], meshes[m]);
+	});
 
-				fbxNormal->GetDirectArray().Add(normal);
-			}
+	for (u32 m = 0; num_meshes > m; ++m)
+	{
+		log.mText += meshLogs[m].mText;
+
+		if (meshBuilt[m]) {
+			data.mMeshes.push_back(std::move(meshes[m]));
 		}
+	}
+}
 
-		// Texture Coord
+qModelSink* CreateModelSink(core::ExportFormat format)
+{
+	switch (format)
+	{
+#ifndef PERMTOFBX_NO_FBXSDK
+	case core::EXPORT_FORMAT_FBX:
+		return new qFBXSDKWriter;
+#endif
+	case core::EXPORT_FORMAT_FBX_NATIVE:
+	{
+		auto writer = new qFBXWriter;
+		writer->mCompress = core::gCompressArrays;
+		return writer;
+	}
+	case core::EXPORT_FORMAT_GLB:
+	{
+		auto writer = new qGLBWriter;
+		writer->mQuantize = core::gQuantizeVertices;
+		return writer;
+	}
+	}
 
-		if (auto stream_element = core::GetVertexStreamElement(vertexStreamDesc, Illusion::VERTEX_ELEMENT_TEXCOORD0))
-		{
-			auto uvBuffer = mesh->mVertexBufferHandles[stream_element->mStream].GetData();
+	return 0;
+}
 
-			for (u32 v = 0; uvBuffer->mNumElements > v; ++v)
-			{
-				auto data = core::GetVertexStreamData(vertexStreamDesc, stream_element, uvBuffer, v);
-				fbxsdk::FbxVector2 uv = { 0.0, 1.0 };
-
-				for (int i = 0; 2 > i; ++i)
-				{
-					switch (stream_element->mType)
-					{
-					case Illusion::VERTEX_TYPE_HALF2:
-						uv[i] = static_cast<double>(static_cast<qHalfFloat*>(data)[i].Get()); break;
-					}
-				}
+// Serializes finished scenes on its own threads, so the next model is decoded while the last one is written.
+// Push blocks while kQueueDepth scenes are waiting, which bounds how many decoded scenes are held in memory.
+class SceneWriter
+{
+public:
+	static constexpr size_t kQueueDepth = 2;
 
-				uv[1] = 1.0 - uv[1];
+	jobs::TaskPool mPool;
+	std::mutex mSinkMutex;
+	std::vector<qModelSink*> mSinks; // Free sinks, backends keep their scratch buffers between scenes.
+	qString mOutputPath;
 
-				fbxUV->GetDirectArray().Add(uv);
-			}
+	SceneWriter(const char* output_path, core::ExportFormat format, u32 num_threads)
+	{
+		mOutputPath = output_path;
+
+		if (!num_threads) {
+			num_threads = 1;
+		}
+
+		for (u32 i = 0; num_threads > i; ++i) {
+			mSinks.push_back(CreateModelSink(format));
 		}
 
-		// Polygons
+		mPool.Start(num_threads, kQueueDepth);
+	}
 
-		if (4 >= indexBuffer->mElementByteSize)
+	~SceneWriter()
+	{
+		mPool.Wait();
+		mPool.Stop();
+
+		for (auto sink : mSinks) {
+			delete sink;
+		}
+	}
+
+	void Push(std::shared_ptr<qModelData> data)
+	{
+		mPool.Push([this, data]()
 		{
-			auto indices = static_cast<u8*>(indexBuffer->mData.Get(indexBuffer->mElementByteSize * mesh->mIndexStart));
-			for (u32 p = 0; mesh->mNumPrims > p; ++p)
+			qModelSink* sink;
 			{
-				fbxMesh->BeginPolygon();
+				std::lock_guard<std::mutex> lock(mSinkMutex);
+				sink = mSinks.back();
+				mSinks.pop_back();
+			}
 
-				for (int i = 0; 3 > i; ++i)
-				{
-					int index = 0;
-					memcpy(&index, indices, indexBuffer->mElementByteSize);
+			qString filename = { "%s" PATH_SEPARATOR "%s.%s", mOutputPath.mData, data->mName.c_str(), sink->GetExtension() };
 
-					fbxMesh->AddPolygon(index);
-					fbxUV->GetIndexArray().Add(index);
+			bool written;
+			{
+				PROFILE_SCOPE("WriteScene", data->mName.c_str());
+				written = sink->Write(*data, filename);
+			}
 
-					indices = &indices[indexBuffer->mElementByteSize];
-				}
+			if (!written)
+			{
+				core::LogBuffer log;
+				log.Printf("[ ERROR ] Failed to export: %s\n", filename.mData);
+				log.Flush();
+			}
+			else if (Profile::gEnabled) {
+				Profile::Add(Profile::COUNTER_BYTES_WRITTEN, core::GetFileSize(filename));
+			}
+
+			std::lock_guard<std::mutex> lock(mSinkMutex);
+			mSinks.push_back(sink);
+		});
+	}
+};
+
+void ExportModel(Illusion::Model* mdl, RigIndex::Rig* rig, SceneWriter& writer, core::LogBuffer& log)
+{
+	log.Printf("[ INFO ] Exporting: %s\n", mdl->mDebugName);
 
-				fbxMesh->EndPolygon();
+	auto data = std::make_shared<qModelData>();
+	BuildModelData(writer.mOutputPath, mdl, rig, log, *data);
+
+	writer.Push(std::move(data));
+}
+
+// Rig the model gets skinned with, 0 when it has no bone palette or no rig matches it.
+RigIndex::Rig* FindModelRig(Illusion::Model* mdl, RigIndex::Rig* rig)
+{
+	auto bonePalette = static_cast<Illusion::BonePalette*>(ResourceIndex::Get(RTypeUID_BonePalette, mdl->mBonePaletteHandle.mNameUID));
+	if (!bonePalette) {
+		return 0;
+	}
+
+	if (!rig && !RigIndex::gRigs.empty()) {
+		rig = RigIndex::FindRig(bonePalette);
+	}
+
+	return (rig && rig->GetPalette(bonePalette).mMatch == RigIndex::PALETTE_MATCH ? rig : 0);
+}
+
+struct RigScene
+{
+	RigIndex::Rig* mRig;
+	qString mName;
+	std::vector<Illusion::Model*> mModels;
+};
+
+// One scene with the skeleton built once and the meshes & skins of every model using the rig.
+void ExportRigScene(const RigScene& scene, SceneWriter& writer, core::LogBuffer& log)
+{
+	log.Printf("[ INFO ] Exporting: %s (%u models)\n", scene.mName.mData, static_cast<u32>(scene.mModels.size()));
+
+	auto data = std::make_shared<qModelData>();
+	data->mName = scene.mName.mData;
+	data->mSkinName = scene.mName.mData;
+	data->mBones = scene.mRig->mBones;
+
+	for (auto mdl : scene.mModels) {
+		BuildModelData(writer.mOutputPath, mdl, scene.mRig, log, *data);
+	}
+
+	writer.Push(std::move(data));
+}
+
+//--------------------------------------------------
+//	Batch Logic
+//--------------------------------------------------
+
+// Scenes per rig (stream batches), later batches of the same rig get a numbered file instead of overwriting it.
+std::unordered_map<RigIndex::Rig*, u32> gRigSceneCounts;
+
+// Splits models into one scene per rig, models without a matching rig stay on their own.
+void GroupModelsByRig(const std::vector<Illusion::Model*>& models, RigIndex::Rig* rig, std::vector<RigScene>& scenes, std::vector<Illusion::Model*>& singles)
+{
+	std::unordered_map<RigIndex::Rig*, size_t> sceneIndices;
+
+	for (auto mdl : models)
+	{
+		auto modelRig = FindModelRig(mdl, rig);
+		if (!modelRig)
+		{
+			singles.push_back(mdl);
+			continue;
+		}
+
+		auto result = sceneIndices.emplace(modelRig, scenes.size());
+		if (result.second)
+		{
+			u32 count = gRigSceneCounts[modelRig]++;
+
+			RigScene scene = { modelRig, modelRig->mResource->mDebugName };
+			if (count) {
+				scene.mName = { "%s_%u", modelRig->mResource->mDebugName, count };
 			}
+
+			scenes.push_back(scene);
 		}
 
-		// Blend Indexes & Weights (Rig)
+		scenes[result.first->second].mModels.push_back(mdl);
+	}
+}
 
-		auto index_element = core::GetVertexStreamElement(vertexStreamDesc, Illusion::VERTEX_ELEMENT_BLENDINDEX);
-		auto weight_element = core::GetVertexStreamElement(vertexStreamDesc, Illusion::VERTEX_ELEMENT_BLENDWEIGHT);
+void RebuildIndices()
+{
+	ResourceIndex::Build({ &gMaterialInventory, &gModelInventory, &gTextureInventory, &gBufferInventory, &gBonePaletteInventory, &gRigResourceInventory });
+	TextureManager::BuildFileRanges();
+}
 
-		if (index_element && weight_element && fbxSkin)
+// Collects loaded models matching -model=, exported_uids (stream mode) skips models exported by earlier batches.
+void CollectModels(const qString& model_name, std::unordered_set<u32>* exported_uids, std::vector<Illusion::Model*>& models)
+{
+	for (auto resource : gModelInventory.mResourceDatas)
+	{
+		auto mdl = static_cast<Illusion::Model*>(resource);
+
+		if (exported_uids && !exported_uids->insert(mdl->mNode.mUID).second) {
+			continue;
+		}
+
+		if (!model_name.IsEmpty())
 		{
-			fbxsdk::FbxArray<u32> boneNames;
-			for (int i = 0; num_bones > i; ++i)
+			u32 model_nameuid = mdl->mNode.mUID;
+			if (model_nameuid != model_name.GetStringHash32() && model_nameuid != model_name.GetStringHashUpper32() && qStringCompareInsensitive(mdl->mDebugName, model_name) != 0)
 			{
-				auto name = fbxBoneNodes[i]->GetName();
-				boneNames.Add(qStringHashUpper32(name));
+				qPrintf("[ INFO ] Ignoring %s\n", mdl->mDebugName);
+				continue;
 			}
+		}
 
-			fbxsdk::FbxArray<fbxsdk::FbxCluster*> fbxClusters;
-			auto& matrix = fbxNode->EvaluateGlobalTransform();
+		core::InitModelHandles(mdl);
+		models.push_back(mdl);
+	}
+}
 
-			for (u32 i = 0; bonePalette->mNumBones > i; ++i)
-			{
-				fbxsdk::FbxNode* node = 0;
-				u32 bone_uid = *bonePalette->mBoneUIDTable[i];
-
-				for (int i = 0; num_bones > i; ++i)
-				{
-					if (bone_uid == boneNames[i])
-					{
-						node = fbxBoneNodes[i];
-						break;
-					}
-				}
+void ExportModels(const char* output_path, core::ExportFormat format, const std::vector<Illusion::Model*>& models, RigIndex::Rig* rig, u32 num_jobs)
+{
+	PROFILE_SCOPE("ExportModels");
 
-				fbxClusters.Add(fbxModel.CreateCluster(fbxSkin, node, matrix));
-			}
+	std::vector<RigScene> scenes;
+	std::vector<Illusion::Model*> singles;
 
-			if (fbxClusters.Size() > 0)
-			{
-				auto indexBuffer = mesh->mVertexBufferHandles[index_element->mStream].GetData();
-				auto weightBuffer = mesh->mVertexBufferHandles[weight_element->mStream].GetData();
-
-				for (u32 v = 0; weightBuffer->mNumElements > v; ++v)
-				{
-					auto indexes = static_cast<u8*>(core::GetVertexStreamData(vertexStreamDesc, index_element, indexBuffer, v));
-					auto weights = static_cast<u8*>(core::GetVertexStreamData(vertexStreamDesc, weight_element, weightBuffer, v));
-
-					for (int i = 0; 4 > i; ++i)
-					{
-						u8 bone_index = indexes[i];
-						f32 weight = static_cast<f32>(weights[i]) / 255.f;
-
-						auto cluster = fbxClusters[bone_index];
-						if (!cluster) {
-							continue;
-						}
-
-						cluster->AddControlPointIndex(v, weight);
-					}
-				}
+	if (core::gCombineByRig) {
+		GroupModelsByRig(models, rig, scenes, singles);
+	}
+	else {
+		singles = models;
+	}
+
+	const u32 num_exports = static_cast<u32>(scenes.size() + singles.size());
+
+	// Workers decode, the scene writer serializes with one thread per worker.
+
+	if (num_jobs > num_exports) {
+		num_jobs = num_exports;
+	}
+
+	{
+		SceneWriter writer(output_path, format, num_jobs);
+
+		// Scenes first, they are the largest exports.
+		jobs::ParallelFor(num_exports, num_jobs, [&](u32 index, u32 worker)
+		{
+			core::LogBuffer log;
 
-				fbxMesh->AddDeformer(fbxSkin);
+			if (scenes.size() > index) {
+				ExportRigScene(scenes[index], writer, log);
 			}
+			else {
+				ExportModel(singles[index - scenes.size()], rig, writer, log);
+			}
+
+			log.Flush();
+		});
+	}
+
+	TextureManager::DrainExportService();
+	TextureManager::ReleaseTempFiles();
+}
+
+// Splits the streamed files into batches of whole perm groups that fit into the memory budget.
+void BuildStreamBatches(const std::vector<std::string>& files, u64 mem_budget, std::vector<std::vector<std::string>>& batches)
+{
+	std::vector<std::vector<std::string>> groups;
+	std::unordered_map<std::string, size_t> groupIndices;
+
+	for (auto& file : files)
+	{
+		if (!core::IsStreamedFile(file)) {
+			continue;
+		}
+
+		auto result = groupIndices.emplace(core::GetPermGroupKey(file), groups.size());
+		if (result.second) {
+			groups.emplace_back();
 		}
+
+		groups[result.first->second].push_back(file);
 	}
 
-	qString filename = { "%s\\%s.fbx", output_path, mdl->mDebugName };
-	if (auto device = gQuarkFileSystem.MapFilenameToDevice(output_path)) {
-		device->CreateDirectoryA(output_path);
+	u64 batch_size = 0;
+
+	for (auto& group : groups)
+	{
+		u64 group_size = 0;
+		for (auto& file : group) {
+			group_size += core::GetFileSize(file.c_str());
+		}
+
+		if (batches.empty() || (batch_size && (batch_size + group_size) > mem_budget))
+		{
+			batches.emplace_back();
+			batch_size = 0;
+		}
+
+		batches.back().insert(batches.back().end(), group.begin(), group.end());
+		batch_size += group_size;
 	}
-	fbxModel.Export(mgr, filename);
 }
 
 int main(int argc, char** argv)
@@ -356,22 +636,39 @@ int main(int argc, char** argv)
 	qString output_path = "output";
 	qString rig_name;
 	qString model_name;
+	u32 num_jobs = 1;
+	bool stream = 0;
+	u64 mem_budget = 1024ull << 20;
+	qString index_path;
+	core::ExportFormat format = core::EXPORT_FORMAT_DEFAULT;
+	qString manifest_path;
+	std::vector<std::string> files;
 
 	// Handle Arguments
 
+	// -profile= is picked up first so everything after this point is timed, including wildcard scans.
+	Profile::ShutdownGuard profile_guard;
+
 	for (int i = 1; argc > i; ++i)
 	{
-		qString arg = argv[i];
-
-		if (core::IsPermFile(arg))
-		{
-			StreamResourceLoader::LoadResourceFile(arg);
-			continue;
+		if (auto param = core::GetParamValue(argv[i], "-profile=")) {
+			Profile::Enable(param);
 		}
+	}
+
+	for (int i = 1; argc > i; ++i)
+	{
+		qString arg = argv[i];
 
-		if (arg.EndsWith("\\*") || arg.EndsWith("/*") || arg.EndsWith("\\**") || arg.EndsWith("/**"))
+		// Only non-option arguments are paths, option values (-output=, -model=, ...) may contain wildcards too.
+		if (arg.mData[0] != '-')
 		{
-			core::LoadPermFiles(arg);
+			if (FileScan::HasWildcard(arg)) {
+				FileScan::FindPermFiles(arg, files);
+			}
+			else if (core::IsPermFile(arg)) {
+				files.push_back(arg.mData);
+			}
 			continue;
 		}
 
@@ -392,54 +689,235 @@ int main(int argc, char** argv)
 			model_name = param;
 			continue;
 		}
+
+		if (auto param = core::GetParamValue(arg, "-jobs="))
+		{
+			if (!core::GetJobCount(param, num_jobs))
+			{
+				qPrintf("ERROR: Invalid job count (%s)!\n", param);
+				return 1;
+			}
+
+			// Every job owns an export thread, a writer sink (and FbxManager), more than the cores only costs memory.
+			const u32 num_hardware_threads = jobs::GetHardwareThreads();
+			if (!num_jobs || num_jobs > num_hardware_threads) {
+				num_jobs = num_hardware_threads;
+			}
+			continue;
+		}
+
+		if (auto param = core::GetParamValue(arg, "-mem-budget="))
+		{
+			if (!core::GetMemoryBudget(param, mem_budget))
+			{
+				qPrintf("ERROR: Invalid memory budget (%s)!\n", param);
+				return 1;
+			}
+			continue;
+		}
+
+		if (auto param = core::GetParamValue(arg, "-index="))
+		{
+			index_path = param;
+			continue;
+		}
+
+		if (auto param = core::GetParamValue(arg, "-manifest="))
+		{
+			manifest_path = param;
+			continue;
+		}
+
+		if (auto param = core::GetParamValue(arg, "-format="))
+		{
+			if (!core::GetExportFormat(param, format))
+			{
+				qPrintf("ERROR: Unknown export format (%s)!\n", param);
+				return 1;
+			}
+			continue;
+		}
+
+		if (auto param = core::GetParamValue(arg, "-axis="))
+		{
+			if (!core::GetAxisSystem(param, core::gAxisSystem))
+			{
+				qPrintf("ERROR: Unknown axis system (%s)!\n", param);
+				return 1;
+			}
+			continue;
+		}
+
+		if (qStringCompareInsensitive(arg, "-compress") == 0)
+		{
+			core::gCompressArrays = 1;
+			continue;
+		}
+
+		if (auto param = core::GetParamValue(arg, "-combine="))
+		{
+			if (qStringCompareInsensitive(param, "rig") != 0)
+			{
+				qPrintf("ERROR: Unknown combine mode (%s)!\n", param);
+				return 1;
+			}
+
+			core::gCombineByRig = 1;
+			continue;
+		}
+
+		if (qStringCompareInsensitive(arg, "-quantize") == 0)
+		{
+			core::gQuantizeVertices = 1;
+			continue;
+		}
+
+		if (core::GetParamValue(arg, "-profile=")) {
+			continue;
+		}
+
+		if (qStringCompareInsensitive(arg, "-stream") == 0)
+		{
+			stream = 1;
+			continue;
+		}
+	}
+
+	// Overlapping wildcards or a wildcard plus an explicit path must not load the same file twice.
+	std::sort(files.begin(), files.end());
+	files.erase(std::unique(files.begin(), files.end()), files.end());
+
+	const bool auto_rig = (qStringCompareInsensitive(rig_name, "auto") == 0);
+
+	{
+		const u32 num_hardware_threads = jobs::GetHardwareThreads();
+		gMeshPool.Start(num_hardware_threads > num_jobs ? num_hardware_threads - num_jobs : 0);
+	}
+
+	// Manifest...
+
+	if (!index_path.IsEmpty()) {
+		return (Manifest::Build(files, { &gMaterialInventory, &gModelInventory, &gTextureInventory, &gBufferInventory, &gBonePaletteInventory, &gRigResourceInventory }, index_path) ? 0 : 1);
+	}
+
+	if (!manifest_path.IsEmpty() && !model_name.IsEmpty())
+	{
+		Manifest::Data manifest;
+		std::vector<std::string> modelFiles;
+
+		u32 rig_uid = (rig_name.IsEmpty() || auto_rig ? 0 : rig_name.GetStringHashUpper32());
+
+		if (manifest.Read(manifest_path) && Manifest::ResolveModelFiles(manifest, Manifest::GetDirectory(manifest_path), model_name, rig_uid, auto_rig, modelFiles))
+		{
+			qPrintf("[ INFO ] Manifest: loading %u of %u files\n", static_cast<u32>(modelFiles.size()), static_cast<u32>(manifest.mFiles.size()));
+			files = modelFiles;
+		}
+		else {
+			qPrintf("[ WARN ] Manifest (%s) is missing, out of date or doesn't contain %s, loading all files\n", manifest_path.mData, model_name.mData);
+		}
+	}
+
+	// Load Files...
+
+	{
+		std::vector<std::string> loadFiles;
+		for (auto& file : files)
+		{
+			if (!stream || !core::IsStreamedFile(file)) {
+				loadFiles.push_back(file);
+			}
+		}
+
+		FileLoader::LoadFiles(loadFiles);
 	}
 
 	// Load Rig...
 
-	RigResource* rig = 0;
+	RigIndex::Rig* rig = 0;
 
-	if (!rig_name.IsEmpty())
+	if (auto_rig) {
+		RigIndex::BuildAll(&gRigResourceInventory);
+	}
+	else if (!rig_name.IsEmpty())
 	{
-		rig = static_cast<RigResource*>(gRigResourceInventory.Get(rig_name.GetStringHashUpper32()));
-		if (!rig)
+		auto rigResource = static_cast<RigResource*>(gRigResourceInventory.Get(rig_name.GetStringHashUpper32()));
+		if (!rigResource)
 		{
 			qPrintf("ERROR: Failed to find rig (%s)!\nDid you forgot to load file with the specific rig?\n", rig_name.mData);
 			return 1;
 		}
 
-		rig->mSkeleton = static_cast<hkaSkeleton*>(NativePackfileUtils::loadInPlace(rig->GetHavokMemImagedData(), rig->mHavokMemImagedDataSize, 0));
+		rig = RigIndex::Build(rigResource);
 	}
 
 	// Handle exporting...
 
-	if (gModelInventory.mResourceDatas.IsEmpty())
-	{
-		qPrintf("ERROR: No models has been loaded!\n");
-		return 1;
+	if (auto device = gQuarkFileSystem.MapFilenameToDevice(output_path)) {
+		device->CreateDirectoryA(output_path);
 	}
 
-	auto sdkMgr = fbxsdk::FbxManager::Create();
+	TextureManager::StartExportService(4);
 
-	auto ios = fbxsdk::FbxIOSettings::Create(sdkMgr, IOSROOT);
-	sdkMgr->SetIOSettings(ios);
+	if (!stream)
+	{
+		if (gModelInventory.mResourceDatas.IsEmpty())
+		{
+			qPrintf("ERROR: No models has been loaded!\n");
+			return 1;
+		}
 
-	for (auto resource : gModelInventory.mResourceDatas)
+		RebuildIndices();
+
+		std::vector<Illusion::Model*> models;
+		CollectModels(model_name, 0, models);
+
+		ExportModels(output_path, format, models, rig, num_jobs);
+	}
+	else
 	{
-		auto mdl = static_cast<Illusion::Model*>(resource);
+		// Load -> export -> unload one batch at a time so only a budget worth of perm files is resident.
 
-		if (!model_name.IsEmpty())
+		std::vector<std::vector<std::string>> batches;
+		BuildStreamBatches(files, mem_budget, batches);
+
+		std::unordered_set<u32> exportedUIDs;
+
+		for (size_t b = 0; batches.size() > b; ++b)
 		{
-			u32 model_nameuid = mdl->mNode.mUID;
-			if (model_nameuid != model_name.GetStringHash32() && model_nameuid != model_name.GetStringHashUpper32() && qStringCompareInsensitive(mdl->mDebugName, model_name) != 0)
-			{
-				qPrintf("[ INFO ] Ignoring %s\n", mdl->mDebugName);
-				continue;
-			}
+			auto& batch = batches[b];
+			qPrintf("[ INFO ] Loading batch %u/%u (%u files)\n", static_cast<u32>(b + 1), static_cast<u32>(batches.size()), static_cast<u32>(batch.size()));
+
+			FileLoader::LoadFiles(batch);
+
+			RebuildIndices();
+
+			std::vector<Illusion::Model*> models;
+			CollectModels(model_name, &exportedUIDs, models);
+
+			ExportModels(output_path, format, models, rig, num_jobs);
+
+			FileLoader::UnloadFiles(batch);
 		}
 
-		ExportModel(output_path, sdkMgr, mdl, rig);
+		if (batches.empty())
+		{
+			RebuildIndices();
+
+			std::vector<Illusion::Model*> models;
+			CollectModels(model_name, &exportedUIDs, models);
+
+			ExportModels(output_path, format, models, rig, num_jobs);
+		}
+
+		if (exportedUIDs.empty())
+		{
+			qPrintf("ERROR: No models has been loaded!\n");
+			return 1;
+		}
 	}
 
+	Profile::Shutdown();
+
 	qClose();
 
 	return 0;
@@ -0,0 +1,450 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Manifest of every resource in a set of perm files (type, name, file & offset) together with the resources
+// that models and materials reference, so -model= runs only load the files the model depends on.
+// File paths are stored relative to the manifest's directory, so -manifest= works from any working directory.
+
+namespace Manifest
+{
+	using namespace UFG;
+
+	constexpr u32 kMagic = 0x4D465450; // "PTFM"
+	constexpr u32 kVersion = 2;
+
+	struct Header
+	{
+		u32 mMagic;
+		u32 mVersion;
+		u32 mNumFiles;
+		u32 mNumResources;
+		u32 mNumDeps;
+		u32 mStringsSize;
+	};
+
+	struct File
+	{
+		u32 mPath;
+		u32 mPad;
+		u64 mSize;
+		u64 mModifiedTime;
+	};
+
+	struct Resource
+	{
+		u32 mTypeUID;
+		u32 mNameUID;
+		u32 mFile;
+		u32 mOffset;
+		u32 mDebugName;
+		u32 mFirstDep;
+		u32 mNumDeps;
+	};
+
+	struct Dependency
+	{
+		u32 mTypeUID;
+		u32 mNameUID;
+	};
+
+	class Data
+	{
+	public:
+		std::vector<File> mFiles;
+		std::vector<Resource> mResources;
+		std::vector<Dependency> mDeps;
+		std::vector<char> mStrings;
+
+		u32 AddString(const char* str)
+		{
+			u32 offset = static_cast<u32>(mStrings.size());
+			mStrings.insert(mStrings.end(), str, &str[strlen(str) + 1]);
+			return offset;
+		}
+
+		const char* GetString(u32 offset) const
+		{
+			return (mStrings.size() > offset ? &mStrings[offset] : "");
+		}
+
+		bool Write(const char* filename) const
+		{
+			FILE* file = fopen(filename, "wb");
+			if (!file) {
+				return 0;
+			}
+
+			Header header = { kMagic, kVersion, static_cast<u32>(mFiles.size()), static_cast<u32>(mResources.size()), static_cast<u32>(mDeps.size()), static_cast<u32>(mStrings.size()) };
+
+			bool written = (fwrite(&header, sizeof(header), 1, file) == 1);
+			written &= (fwrite(mFiles.data(), sizeof(File), mFiles.size(), file) == mFiles.size());
+			written &= (fwrite(mResources.data(), sizeof(Resource), mResources.size(), file) == mResources.size());
+			written &= (fwrite(mDeps.data(), sizeof(Dependency), mDeps.size(), file) == mDeps.size());
+			written &= (fwrite(mStrings.data(), 1, mStrings.size(), file) == mStrings.size());
+
+			fclose(file);
+			return written;
+		}
+
+		bool Read(const char* filename)
+		{
+			FILE* file = fopen(filename, "rb");
+			if (!file) {
+				return 0;
+			}
+
+			Header header;
+			bool read = (fread(&header, sizeof(header), 1, file) == 1 && header.mMagic == kMagic && header.mVersion == kVersion);
+
+			if (read)
+			{
+				mFiles.resize(header.mNumFiles);
+				mResources.resize(header.mNumResources);
+				mDeps.resize(header.mNumDeps);
+				mStrings.resize(header.mStringsSize);
+
+				read &= (fread(mFiles.data(), sizeof(File), mFiles.size(), file) == mFiles.size());
+				read &= (fread(mResources.data(), sizeof(Resource), mResources.size(), file) == mResources.size());
+				read &= (fread(mDeps.data(), sizeof(Dependency), mDeps.size(), file) == mDeps.size());
+				read &= (fread(mStrings.data(), 1, mStrings.size(), file) == mStrings.size());
+			}
+
+			fclose(file);
+			return read;
+		}
+	};
+
+	//--------------------------------------------------
+	//	Paths
+	//--------------------------------------------------
+
+	bool IsSeparator(char c) { return (c == '\\' || c == '/'); }
+
+	bool IsAbsolutePath(const char* path)
+	{
+#ifdef _WIN32
+		return (IsSeparator(path[0]) || (path[0] && path[1] == ':'));
+#else
+		return (path[0] == '/');
+#endif
+	}
+
+	// Directory part of filename including the trailing separator, empty for the working directory.
+	std::string GetDirectory(const char* filename)
+	{
+		std::string directory = filename;
+		while (!directory.empty() && !IsSeparator(directory.back())) {
+			directory.pop_back();
+		}
+		return directory;
+	}
+
+	bool GetAbsolutePath(const char* path, std::string& absolute)
+	{
+#ifdef _WIN32
+		char buffer[MAX_PATH];
+		if (!_fullpath(buffer, path, sizeof(buffer))) {
+			return 0;
+		}
+		absolute = buffer;
+#else
+		char* resolved = realpath(path, 0);
+		if (!resolved) {
+			return 0;
+		}
+		absolute = resolved;
+		free(resolved);
+#endif
+		return 1;
+	}
+
+	void SplitPath(const std::string& path, std::vector<std::string>& parts)
+	{
+		std::string part;
+
+		for (char c : path)
+		{
+			if (!IsSeparator(c))
+			{
+				part += c;
+				continue;
+			}
+
+			if (!part.empty()) {
+				parts.push_back(part);
+			}
+			part.clear();
+		}
+
+		if (!part.empty()) {
+			parts.push_back(part);
+		}
+	}
+
+	// Path of an existing file relative to directory ("" = working directory), absolute when they share no root (other drive).
+	std::string MakeRelativePath(const char* path, const std::string& directory)
+	{
+		std::string absolute_path, absolute_directory;
+		if (!GetAbsolutePath(path, absolute_path) || !GetAbsolutePath((directory.empty() ? "." : directory.c_str()), absolute_directory)) {
+			return path;
+		}
+
+		std::vector<std::string> path_parts, directory_parts;
+		SplitPath(absolute_path, path_parts);
+		SplitPath(absolute_directory, directory_parts);
+
+		size_t common = 0;
+		while (directory_parts.size() > common && (path_parts.size() - 1) > common)
+		{
+#ifdef _WIN32
+			if (qStringCompareInsensitive(path_parts[common].c_str(), directory_parts[common].c_str()) != 0) {
+				break;
+			}
+#else
+			if (path_parts[common] != directory_parts[common]) {
+				break;
+			}
+#endif
+			++common;
+		}
+
+#ifdef _WIN32
+		if (!common) {
+			return absolute_path;
+		}
+#endif
+
+		std::string relative;
+		for (size_t i = common; directory_parts.size() > i; ++i) {
+			relative += ".." PATH_SEPARATOR;
+		}
+
+		for (size_t i = common; path_parts.size() > i; ++i)
+		{
+			relative += path_parts[i];
+			if ((path_parts.size() - 1) > i) {
+				relative += PATH_SEPARATOR;
+			}
+		}
+
+		return relative;
+	}
+
+	std::string ResolvePath(const char* path, const std::string& directory)
+	{
+		return (IsAbsolutePath(path) ? std::string(path) : directory + path);
+	}
+
+	//--------------------------------------------------
+	//	Build
+	//--------------------------------------------------
+
+	void AddDependency(Data& data, u32 type_uid, u32 name_uid)
+	{
+		if (name_uid) {
+			data.mDeps.push_back({ type_uid, name_uid });
+		}
+	}
+
+	// Loads every file on its own, records the resources inside it and unloads it again.
+	bool Build(const std::vector<std::string>& files, std::initializer_list<qResourceInventory*> inventories, const char* filename)
+	{
+		Data data;
+		const std::string directory = GetDirectory(filename);
+		FileLoader::Prefetcher prefetcher(files);
+
+		for (u32 f = 0; files.size() > f; ++f)
+		{
+			auto& path = files[f];
+			qPrintf("[ INFO ] Indexing: %s\n", path.c_str());
+
+			prefetcher.Wait(f);
+
+			File file = { data.AddString(MakeRelativePath(path.c_str(), directory).c_str()), 0, 0, 0 };
+			core::GetFileInfo(path.c_str(), file.mSize, file.mModifiedTime);
+			data.mFiles.push_back(file);
+
+			StreamResourceLoader::LoadResourceFile(path.c_str());
+
+			uptr begin = 0;
+			uptr end = 0;
+
+			for (auto loaded_file : StreamResourceLoader::smLoadedFiles)
+			{
+				if (qStringCompareInsensitive(loaded_file->mFilename, path.c_str()) == 0)
+				{
+					begin = reinterpret_cast<uptr>(loaded_file->mData);
+					end = begin + loaded_file->mDataSize;
+					break;
+				}
+			}
+
+			for (auto inventory : inventories)
+			{
+				for (auto resource : inventory->mResourceDatas)
+				{
+					uptr address = reinterpret_cast<uptr>(resource);
+					if (begin > address || address >= end) {
+						continue;
+					}
+
+					Resource entry = { resource->mTypeUID, resource->mNode.mUID, f, static_cast<u32>(address - begin), data.AddString(resource->mDebugName), static_cast<u32>(data.mDeps.size()), 0 };
+
+					if (resource->mTypeUID == RTypeUID_Model)
+					{
+						auto mdl = static_cast<Illusion::Model*>(resource);
+						AddDependency(data, RTypeUID_BonePalette, mdl->mBonePaletteHandle.mNameUID);
+
+						for (u32 m = 0; mdl->mNumMeshes > m; ++m)
+						{
+							auto mesh = mdl->GetMesh(m);
+							AddDependency(data, RTypeUID_Material, mesh->mMaterialHandle.mNameUID);
+							AddDependency(data, RTypeUID_Buffer, mesh->mIndexBufferHandle.mNameUID);
+
+							for (auto& vertexBufferHandle : mesh->mVertexBufferHandles) {
+								AddDependency(data, RTypeUID_Buffer, vertexBufferHandle.mNameUID);
+							}
+						}
+					}
+					else if (resource->mTypeUID == RTypeUID_Material)
+					{
+						auto material = static_cast<Illusion::Material*>(resource);
+
+						for (u32 p = 0; material->mNumParams > p; ++p)
+						{
+							auto param = material->GetParam(p);
+							if (param->mNameUID == core::MATERIAL_PARAM_DIFFUSE_MAP || param->mNameUID == core::MATERIAL_PARAM_BUMP_MAP) {
+								AddDependency(data, RTypeUID_Texture, param->mResourceHandle.mNameUID);
+							}
+						}
+					}
+
+					entry.mNumDeps = static_cast<u32>(data.mDeps.size()) - entry.mFirstDep;
+					data.mResources.push_back(entry);
+				}
+			}
+
+			StreamResourceLoader::UnloadResourceFile(path.c_str());
+		}
+
+		if (!data.Write(filename))
+		{
+			qPrintf("ERROR: Failed to write manifest (%s)!\n", filename);
+			return 0;
+		}
+
+		qPrintf("[ INFO ] Manifest: %u files, %u resources\n", static_cast<u32>(data.mFiles.size()), static_cast<u32>(data.mResources.size()));
+		return 1;
+	}
+
+	//--------------------------------------------------
+	//	Resolve
+	//--------------------------------------------------
+
+	FORCE_INLINE u64 GetKey(u32 type_uid, u32 name_uid) { return (static_cast<u64>(type_uid) << 32) | name_uid; }
+
+	// Collects the files holding the model and everything it references (materials, textures, buffers, bone palette & rig).
+	// all_rigs (-rig=auto) adds the files of every rig. Fails when the model is unknown or any of those files changed since the manifest was written.
+	// directory is the manifest's own (GetDirectory), relative file paths are resolved against it.
+	bool ResolveModelFiles(const Data& data, const std::string& directory, const qString& model_name, u32 rig_uid, bool all_rigs, std::vector<std::string>& files)
+	{
+		std::unordered_multimap<u64, u32> resources;
+		for (u32 i = 0; data.mResources.size() > i; ++i) {
+			resources.emplace(GetKey(data.mResources[i].mTypeUID, data.mResources[i].mNameUID), i);
+		}
+
+		std::vector<u32> queue;
+		std::vector<bool> visited(data.mResources.size(), 0);
+		std::vector<bool> needed(data.mFiles.size(), 0);
+
+		const u32 name_hash = model_name.GetStringHash32();
+		const u32 name_hash_upper = model_name.GetStringHashUpper32();
+
+		for (u32 i = 0; data.mResources.size() > i; ++i)
+		{
+			auto& resource = data.mResources[i];
+			if (resource.mTypeUID != RTypeUID_Model) {
+				continue;
+			}
+
+			if (resource.mNameUID == name_hash || resource.mNameUID == name_hash_upper || qStringCompareInsensitive(data.GetString(resource.mDebugName), model_name) == 0)
+			{
+				visited[i] = 1;
+				queue.push_back(i);
+			}
+		}
+
+		if (queue.empty()) {
+			return 0;
+		}
+
+		auto visit = [&](u32 type_uid, u32 name_uid)
+		{
+			auto range = resources.equal_range(GetKey(type_uid, name_uid));
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (!visited[it->second])
+				{
+					visited[it->second] = 1;
+					queue.push_back(it->second);
+				}
+			}
+		};
+
+		if (rig_uid) {
+			visit(RTypeUID_RigResource, rig_uid);
+		}
+
+		for (u32 i = 0; all_rigs && data.mResources.size() > i; ++i)
+		{
+			if (data.mResources[i].mTypeUID == RTypeUID_RigResource && !visited[i])
+			{
+				visited[i] = 1;
+				queue.push_back(i);
+			}
+		}
+
+		while (!queue.empty())
+		{
+			auto& resource = data.mResources[queue.back()];
+			queue.pop_back();
+
+			needed[resource.mFile] = 1;
+
+			for (u32 d = 0; resource.mNumDeps > d; ++d)
+			{
+				auto& dep = data.mDeps[resource.mFirstDep + d];
+				visit(dep.mTypeUID, dep.mNameUID);
+			}
+		}
+
+		files.clear();
+
+		for (u32 f = 0; data.mFiles.size() > f; ++f)
+		{
+			if (!needed[f]) {
+				continue;
+			}
+
+			auto& file = data.mFiles[f];
+			auto path = ResolvePath(data.GetString(file.mPath), directory);
+
+			u64 size = 0, modified_time = 0;
+			if (!core::GetFileInfo(path.c_str(), size, modified_time) || size != file.mSize || modified_time != file.mModifiedTime)
+			{
+				qPrintf("[ WARN ] Manifest file is missing or changed: %s\n", path.c_str());
+				return 0;
+			}
+
+			files.push_back(path);
+		}
+
+		return 1;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,168 @@
+#pragma once
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Decoded model ready for an output backend, filled by ExportModel's traversal of the Illusion::Model.
+
+// Column-vector 4x4 matrix, m[column * 4 + row] (same memory layout as FBX & glTF matrices).
+struct qModelMatrix
+{
+	double m[16];
+
+	static qModelMatrix Identity()
+	{
+		qModelMatrix matrix = {};
+		matrix.m[0] = matrix.m[5] = matrix.m[10] = matrix.m[15] = 1.0;
+		return matrix;
+	}
+
+	static qModelMatrix FromTQS(const double* t, const double* q, const double* s)
+	{
+		const double x = q[0], y = q[1], z = q[2], w = q[3];
+
+		qModelMatrix matrix = Identity();
+		matrix.m[0] = (1.0 - 2.0 * (y * y + z * z)) * s[0];
+		matrix.m[1] = (2.0 * (x * y + w * z)) * s[0];
+		matrix.m[2] = (2.0 * (x * z - w * y)) * s[0];
+		matrix.m[4] = (2.0 * (x * y - w * z)) * s[1];
+		matrix.m[5] = (1.0 - 2.0 * (x * x + z * z)) * s[1];
+		matrix.m[6] = (2.0 * (y * z + w * x)) * s[1];
+		matrix.m[8] = (2.0 * (x * z + w * y)) * s[2];
+		matrix.m[9] = (2.0 * (y * z - w * x)) * s[2];
+		matrix.m[10] = (1.0 - 2.0 * (x * x + y * y)) * s[2];
+		matrix.m[12] = t[0];
+		matrix.m[13] = t[1];
+		matrix.m[14] = t[2];
+		return matrix;
+	}
+
+	qModelMatrix operator*(const qModelMatrix& other) const
+	{
+		qModelMatrix result;
+		for (int c = 0; 4 > c; ++c)
+		{
+			for (int r = 0; 4 > r; ++r)
+			{
+				double value = 0.0;
+				for (int k = 0; 4 > k; ++k) {
+					value += m[k * 4 + r] * other.m[c * 4 + k];
+				}
+				result.m[c * 4 + r] = value;
+			}
+		}
+		return result;
+	}
+
+	// Inverse of an affine matrix (last row 0, 0, 0, 1).
+	qModelMatrix InverseAffine() const
+	{
+		const double a00 = m[0], a01 = m[4], a02 = m[8];
+		const double a10 = m[1], a11 = m[5], a12 = m[9];
+		const double a20 = m[2], a21 = m[6], a22 = m[10];
+
+		const double c00 = a11 * a22 - a12 * a21;
+		const double c01 = a02 * a21 - a01 * a22;
+		const double c02 = a01 * a12 - a02 * a11;
+		const double c10 = a12 * a20 - a10 * a22;
+		const double c11 = a00 * a22 - a02 * a20;
+		const double c12 = a02 * a10 - a00 * a12;
+		const double c20 = a10 * a21 - a11 * a20;
+		const double c21 = a01 * a20 - a00 * a21;
+		const double c22 = a00 * a11 - a01 * a10;
+
+		double det = a00 * c00 + a01 * c10 + a02 * c20;
+		det = (fabs(det) > 1e-12 ? 1.0 / det : 0.0);
+
+		qModelMatrix result = Identity();
+		result.m[0] = c00 * det; result.m[4] = c01 * det; result.m[8] = c02 * det;
+		result.m[1] = c10 * det; result.m[5] = c11 * det; result.m[9] = c12 * det;
+		result.m[2] = c20 * det; result.m[6] = c21 * det; result.m[10] = c22 * det;
+
+		for (int r = 0; 3 > r; ++r) {
+			result.m[12 + r] = -(result.m[r] * m[12] + result.m[4 + r] * m[13] + result.m[8 + r] * m[14]);
+		}
+
+		return result;
+	}
+};
+
+struct qModelBone
+{
+	std::string mName;
+	int mParent = -1;
+	double mTranslation[3] = { 0.0, 0.0, 0.0 };
+	double mRotation[4] = { 0.0, 0.0, 0.0, 1.0 }; // Quaternion (x, y, z, w)
+	double mScale[3] = { 1.0, 1.0, 1.0 };
+};
+
+struct qModelMaterial
+{
+	enum Type : u8
+	{
+		TYPE_DIFFUSE,
+		TYPE_BUMP
+	};
+
+	std::string mName;
+	std::string mTextureFilename;
+	u32 mMaterialUID = 0;
+	u32 mTextureUID = 0;
+	Type mType = TYPE_DIFFUSE;
+
+	// Textures are shared per scene by texture & use, materials by material UID.
+	u64 GetTextureKey() const { return (static_cast<u64>(mType) << 32) | mTextureUID; }
+};
+
+struct qModelCluster
+{
+	int mBone = -1;
+	std::vector<int> mIndices;
+	std::vector<double> mWeights;
+};
+
+struct qModelMesh
+{
+	std::string mName;
+	u32 mNumVertices = 0;
+	std::vector<double> mPositions;	// x, y, z, 1
+	std::vector<double> mNormals;	// x, y, z, 1 (empty when the mesh has no normals)
+	std::vector<double> mUVs;		// u, v (empty when the mesh has no texcoords)
+	std::vector<u32> mIndices;		// Triangle list
+	std::vector<qModelMaterial> mMaterials;
+	std::vector<qModelCluster> mClusters;
+};
+
+struct qModelData
+{
+	std::string mName;
+	std::string mSkinName;
+	std::vector<qModelBone> mBones;
+	std::vector<qModelMesh> mMeshes;
+
+	bool IsSkinned() const { return !mBones.empty(); }
+
+	// Global reference pose of every bone, parents always come before their children in havok skeletons.
+	void GetBoneMatrices(std::vector<qModelMatrix>& matrices) const
+	{
+		matrices.resize(mBones.size());
+
+		for (size_t i = 0; mBones.size() > i; ++i)
+		{
+			auto& bone = mBones[i];
+
+			qModelMatrix local = qModelMatrix::FromTQS(bone.mTranslation, bone.mRotation, bone.mScale);
+			matrices[i] = (0 > bone.mParent ? local : matrices[bone.mParent] * local);
+		}
+	}
+};
+
+// Output backend, ExportModel decodes a model once and hands it to the sink selected by -format=.
+class qModelSink
+{
+public:
+	virtual ~qModelSink() {}
+
+	virtual const char* GetExtension() const = 0;
+	virtual bool Write(const qModelData& data, const char* filename) = 0;
+};
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+
+// Compiler & OS differences shared by every header, included right after theory.
+
+#ifdef _MSC_VER
+	#define FORCE_INLINE __forceinline
+#else
+	#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+// Separator for paths built by the tool (output files, textures), inputs may use either.
+#ifdef _WIN32
+	#define PATH_SEPARATOR "\\"
+#else
+	#define PATH_SEPARATOR "/"
+#endif
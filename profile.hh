@@ -0,0 +1,275 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Phase timers & counters enabled by -profile=<trace.json>. Scopes are recorded into per thread buffers and written
+// as Chrome trace events (chrome://tracing, Perfetto) together with a summary table when the run ends.
+// Disabled, a scope or counter costs a single branch on gEnabled.
+
+#define PROFILE_SCOPE_CONCAT2(a, b) a##b
+#define PROFILE_SCOPE_CONCAT(a, b) PROFILE_SCOPE_CONCAT2(a, b)
+#define PROFILE_SCOPE(...) Profile::Scope PROFILE_SCOPE_CONCAT(_profile_scope, __LINE__)(__VA_ARGS__)
+
+namespace Profile
+{
+	using namespace UFG;
+
+	enum Counter : u32
+	{
+		COUNTER_FILES_LOADED,
+		COUNTER_BYTES_LOADED,
+		COUNTER_VERTICES_DECODED,
+		COUNTER_TRIANGLES_DECODED,
+		COUNTER_TEXTURES_WRITTEN,
+		COUNTER_BYTES_WRITTEN,
+		COUNTER_COUNT
+	};
+
+	const char* gCounterNames[COUNTER_COUNT] =
+	{
+		"Files loaded",
+		"Bytes loaded",
+		"Vertices decoded",
+		"Triangles decoded",
+		"Textures written",
+		"Bytes written"
+	};
+
+	struct Event
+	{
+		const char* mName;	// Static string
+		std::string mDetail;
+		u64 mBegin;			// Microseconds since Enable
+		u64 mDuration;
+	};
+
+	struct ThreadEvents
+	{
+		u32 mThreadID;
+		std::vector<Event> mEvents;
+	};
+
+	bool gEnabled = 0;
+	std::string gTracePath;
+	std::chrono::steady_clock::time_point gStart;
+	std::atomic<u64> gCounters[COUNTER_COUNT];
+
+	std::mutex gThreadsMutex;
+	std::vector<std::unique_ptr<ThreadEvents>> gThreads;
+
+	u64 GetTime()
+	{
+		return static_cast<u64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - gStart).count());
+	}
+
+	// Registered once per thread, buffers outlive their threads so the trace can be written at exit.
+	ThreadEvents& GetThreadEvents()
+	{
+		static thread_local ThreadEvents* thread_events = 0;
+
+		if (!thread_events)
+		{
+			std::lock_guard<std::mutex> lock(gThreadsMutex);
+
+			gThreads.emplace_back(new ThreadEvents);
+			thread_events = gThreads.back().get();
+			thread_events->mThreadID = static_cast<u32>(gThreads.size());
+		}
+
+		return *thread_events;
+	}
+
+	void Enable(const char* trace_path)
+	{
+		gEnabled = 1;
+		gTracePath = trace_path;
+		gStart = std::chrono::steady_clock::now();
+
+		for (auto& counter : gCounters) {
+			counter = 0;
+		}
+	}
+
+	FORCE_INLINE void Add(Counter counter, u64 value)
+	{
+		if (gEnabled) {
+			gCounters[counter].fetch_add(value, std::memory_order_relaxed);
+		}
+	}
+
+	class Scope
+	{
+	public:
+		const char* mName;
+		const char* mDetail;
+		u64 mBegin;
+
+		// detail (model, file or texture name) is copied when the scope ends, it only has to live as long as the scope.
+		Scope(const char* name, const char* detail = 0) : mName(name), mDetail(detail), mBegin(gEnabled ? GetTime() : 0) {}
+
+		~Scope()
+		{
+			if (!gEnabled) {
+				return;
+			}
+
+			u64 end = GetTime();
+			GetThreadEvents().mEvents.push_back({ mName, (mDetail ? mDetail : ""), mBegin, end - mBegin });
+		}
+	};
+
+	//--------------------------------------------------
+	//	Output
+	//--------------------------------------------------
+
+	void WriteJsonString(FILE* file, const char* str)
+	{
+		fputc('"', file);
+
+		for (; *str; ++str)
+		{
+			unsigned char c = static_cast<unsigned char>(*str);
+
+			if (c == '"' || c == '\\') {
+				fprintf(file, "\\%c", c);
+			}
+			else if (0x20 > c) {
+				fprintf(file, "\\u%04x", c);
+			}
+			else {
+				fputc(c, file);
+			}
+		}
+
+		fputc('"', file);
+	}
+
+	bool WriteTrace(const char* filename)
+	{
+		FILE* file = fopen(filename, "wb");
+		if (!file) {
+			return 0;
+		}
+
+		fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+
+		bool first = 1;
+		u64 end = 0;
+
+		for (auto& thread : gThreads)
+		{
+			for (auto& event : thread->mEvents)
+			{
+				fprintf(file, "%s{\"name\":", (first ? "" : ",\n"));
+				WriteJsonString(file, event.mName);
+				fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu", thread->mThreadID, static_cast<unsigned long long>(event.mBegin), static_cast<unsigned long long>(event.mDuration));
+
+				if (!event.mDetail.empty())
+				{
+					fputs(",\"args\":{\"name\":", file);
+					WriteJsonString(file, event.mDetail.c_str());
+					fputc('}', file);
+				}
+
+				fputc('}', file);
+
+				first = 0;
+				end = std::max(end, event.mBegin + event.mDuration);
+			}
+		}
+
+		for (u32 c = 0; COUNTER_COUNT > c; ++c)
+		{
+			fprintf(file, "%s{\"name\":", (first ? "" : ",\n"));
+			WriteJsonString(file, gCounterNames[c]);
+			fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":%llu,\"args\":{\"value\":%llu}}", static_cast<unsigned long long>(end), static_cast<unsigned long long>(gCounters[c].load()));
+			first = 0;
+		}
+
+		fputs("\n]}\n", file);
+
+		bool written = !ferror(file);
+		fclose(file);
+		return written;
+	}
+
+	// Totals per scope name (sorted by total time) followed by the counters.
+	void PrintSummary()
+	{
+		struct Total
+		{
+			const char* mName;
+			u64 mCount;
+			u64 mTotal;
+			u64 mMax;
+		};
+
+		std::vector<Total> totals;
+		std::unordered_map<std::string, size_t> indices;
+
+		for (auto& thread : gThreads)
+		{
+			for (auto& event : thread->mEvents)
+			{
+				auto result = indices.emplace(event.mName, totals.size());
+				if (result.second) {
+					totals.push_back({ event.mName, 0, 0, 0 });
+				}
+
+				auto& total = totals[result.first->second];
+				++total.mCount;
+				total.mTotal += event.mDuration;
+				total.mMax = std::max(total.mMax, event.mDuration);
+			}
+		}
+
+		std::sort(totals.begin(), totals.end(), [](const Total& a, const Total& b) { return a.mTotal > b.mTotal; });
+
+		qPrintf("\n[ PROFILE ] %-28s %10s %12s %12s %12s\n", "Scope", "Count", "Total (ms)", "Avg (ms)", "Max (ms)");
+
+		for (auto& total : totals) {
+			qPrintf("[ PROFILE ] %-28s %10llu %12.2f %12.3f %12.3f\n", total.mName, static_cast<unsigned long long>(total.mCount), total.mTotal / 1000.0, (total.mTotal / 1000.0) / total.mCount, total.mMax / 1000.0);
+		}
+
+		qPrintf("[ PROFILE ]\n");
+
+		for (u32 c = 0; COUNTER_COUNT > c; ++c) {
+			qPrintf("[ PROFILE ] %-28s %10llu\n", gCounterNames[c], static_cast<unsigned long long>(gCounters[c].load()));
+		}
+
+		qPrintf("[ PROFILE ] Wall time: %.2f ms\n", GetTime() / 1000.0);
+	}
+
+	// Writes -profile= output, called once all workers have finished. Only the first call writes anything.
+	void Shutdown()
+	{
+		if (!gEnabled) {
+			return;
+		}
+
+		PrintSummary();
+		gEnabled = 0;
+
+		if (!WriteTrace(gTracePath.c_str())) {
+			qPrintf("[ ERROR ] Failed to write profile trace (%s)!\n", gTracePath.c_str());
+		}
+		else {
+			qPrintf("[ INFO ] Profile trace: %s\n", gTracePath.c_str());
+		}
+	}
+
+	// Makes sure every return path of main (errors, -index=) writes the profile.
+	class ShutdownGuard
+	{
+	public:
+		~ShutdownGuard() { Shutdown(); }
+	};
+}
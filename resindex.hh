@@ -0,0 +1,146 @@
+#pragma once
+#include <initializer_list>
+#include <vector>
+
+// Frozen lookup tables for resources and vertex declarations, built once loading has finished.
+// Until Build is called every lookup falls back to the warehouse / stream descriptor list.
+
+namespace ResourceIndex
+{
+	using namespace UFG;
+
+	// Open addressing with linear probing, capacity is kept at power of two and at most half full.
+	template <typename T>
+	class HashTable
+	{
+	public:
+		std::vector<u64> mKeys;
+		std::vector<T*> mValues;
+		u64 mMask = 0;
+
+		static u64 Hash(u64 key)
+		{
+			key ^= (key >> 33);
+			key *= 0xFF51AFD7ED558CCDull;
+			key ^= (key >> 33);
+			key *= 0xC4CEB9FE1A85EC53ull;
+			key ^= (key >> 33);
+			return key;
+		}
+
+		void Init(size_t count)
+		{
+			size_t capacity = 16;
+			while ((count * 2) > capacity) {
+				capacity <<= 1;
+			}
+
+			mKeys.assign(capacity, 0);
+			mValues.assign(capacity, 0);
+			mMask = static_cast<u64>(capacity - 1);
+		}
+
+		void Insert(u64 key, T* value)
+		{
+			for (u64 i = Hash(key) & mMask;; i = (i + 1) & mMask)
+			{
+				if (!mValues[i])
+				{
+					mKeys[i] = key;
+					mValues[i] = value;
+					return;
+				}
+
+				// First registered resource wins, same as the warehouse lookup.
+				if (mKeys[i] == key) {
+					return;
+				}
+			}
+		}
+
+		T* Find(u64 key) const
+		{
+			for (u64 i = Hash(key) & mMask;; i = (i + 1) & mMask)
+			{
+				T* value = mValues[i];
+				if (!value) {
+					return 0;
+				}
+
+				if (mKeys[i] == key) {
+					return value;
+				}
+			}
+		}
+	};
+
+	HashTable<qResourceData> gResources;
+	HashTable<Illusion::VertexStreamDescriptor> gVertexDecls;
+	bool gFrozen = 0;
+
+	FORCE_INLINE u64 GetKey(u32 type_uid, u32 name_uid) { return (static_cast<u64>(type_uid) << 32) | name_uid; }
+
+	void Build(std::initializer_list<qResourceInventory*> inventories)
+	{
+		// The inventory lists have no element count, so they are walked once to size the table.
+		size_t num_resources = 0;
+		for (auto inventory : inventories)
+		{
+			for (auto resource : inventory->mResourceDatas)
+			{
+				(void)resource;
+				++num_resources;
+			}
+		}
+
+		gResources.Init(num_resources);
+
+		for (auto inventory : inventories)
+		{
+			for (auto resource : inventory->mResourceDatas) {
+				gResources.Insert(GetKey(resource->mTypeUID, resource->mNode.mUID), resource);
+			}
+		}
+
+		auto streamDescriptors = Illusion::VertexStreamDescriptor::GetStreamDescriptors();
+		size_t num_decls = 0;
+
+		for (auto streamDescriptor = streamDescriptors->begin(); streamDescriptor != streamDescriptors->end(); streamDescriptor = streamDescriptor->next()) {
+			++num_decls;
+		}
+
+		gVertexDecls.Init(num_decls);
+
+		for (auto streamDescriptor = streamDescriptors->begin(); streamDescriptor != streamDescriptors->end(); streamDescriptor = streamDescriptor->next()) {
+			gVertexDecls.Insert(streamDescriptor->mNameUID, streamDescriptor);
+		}
+
+		gFrozen = 1;
+	}
+
+	qResourceData* Get(u32 type_uid, u32 name_uid)
+	{
+		if (!gFrozen) {
+			return qResourceWarehouse::Instance()->DebugGet(type_uid, name_uid);
+		}
+
+		return gResources.Find(GetKey(type_uid, name_uid));
+	}
+
+	Illusion::VertexStreamDescriptor* GetVertexDecl(u32 name_uid)
+	{
+		if (gFrozen) {
+			return gVertexDecls.Find(name_uid);
+		}
+
+		auto streamDescriptors = Illusion::VertexStreamDescriptor::GetStreamDescriptors();
+		for (auto streamDescriptor = streamDescriptors->begin(); streamDescriptor != streamDescriptors->end(); streamDescriptor = streamDescriptor->next())
+		{
+			if (streamDescriptor->mNameUID == name_uid) {
+				return streamDescriptor;
+			}
+		}
+
+		return 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,209 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Per rig lookup tables built once after the skeleton is loaded in place: bone name hash -> skeleton index,
+// the decoded reference pose and a cache of bone palette -> skeleton index tables.
+// With -rig=auto every loaded rig is indexed and each bone palette picks its rig through bone hash signatures.
+
+namespace RigIndex
+{
+	using namespace UFG;
+
+	enum PaletteMatch : u8
+	{
+		PALETTE_MATCH,
+		PALETTE_TOO_MANY_BONES,
+		PALETTE_MISSING_BONES
+	};
+
+	struct Palette
+	{
+		PaletteMatch mMatch = PALETTE_MATCH;
+		std::vector<int> mBones; // Palette index -> skeleton bone index
+	};
+
+	// 256-bit bloom filter of bone name hashes, 2 bits per bone.
+	struct Signature
+	{
+		u64 mBits[4] = { 0, 0, 0, 0 };
+
+		void Add(u32 bone_uid)
+		{
+			mBits[(bone_uid >> 6) & 3] |= (1ull << (bone_uid & 63));
+			mBits[(bone_uid >> 14) & 3] |= (1ull << ((bone_uid >> 8) & 63));
+		}
+
+		bool MayContain(const Signature& other) const
+		{
+			for (int i = 0; 4 > i; ++i)
+			{
+				if (other.mBits[i] & ~mBits[i]) {
+					return 0;
+				}
+			}
+			return 1;
+		}
+	};
+
+	class Rig
+	{
+	public:
+		RigResource* mResource = 0;
+		Signature mSignature;
+		std::unordered_map<u32, int> mBoneIndices;
+		std::vector<qModelBone> mBones; // Reference pose in the output axis system
+
+		std::mutex mPaletteMutex;
+		std::unordered_map<u32, Palette> mPalettes;
+
+		void Init(RigResource* resource)
+		{
+			auto skeleton = resource->mSkeleton;
+			int num_bones = skeleton->m_bones.m_size;
+
+			mResource = resource;
+			mBoneIndices.reserve(static_cast<size_t>(num_bones));
+			mBones.resize(static_cast<size_t>(num_bones));
+
+			for (int i = 0; num_bones > i; ++i)
+			{
+				auto bone = &skeleton->m_bones.m_data[i];
+				auto trans = &skeleton->m_referencePose.m_data[i];
+				auto& modelBone = mBones[i];
+
+				u32 bone_uid = qStringHashUpper32(bone->m_name);
+				mBoneIndices.emplace(bone_uid, i);
+				mSignature.Add(bone_uid);
+
+				modelBone.mName = bone->m_name;
+				modelBone.mParent = skeleton->m_parentIndices.m_data[i];
+
+				for (int c = 0; 3 > c; ++c)
+				{
+					modelBone.mTranslation[c] = static_cast<double>(trans->m_translation.m_quad.m128_f32[c]);
+					modelBone.mScale[c] = static_cast<double>(trans->m_scale.m_quad.m128_f32[c]);
+				}
+
+				for (int c = 0; 4 > c; ++c) {
+					modelBone.mRotation[c] = static_cast<double>(trans->m_rotation.m_vec.m_quad.m128_f32[c]);
+				}
+
+				VertexDecode::ConvertTransform(core::gAxisSystem, modelBone.mTranslation, modelBone.mRotation, modelBone.mScale);
+			}
+		}
+
+		int FindBone(u32 bone_uid) const
+		{
+			auto find = mBoneIndices.find(bone_uid);
+			return (find != mBoneIndices.end() ? find->second : -1);
+		}
+
+		// Matches the palette against the skeleton once, later calls return the cached table.
+		const Palette& GetPalette(Illusion::BonePalette* bone_palette)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mPaletteMutex);
+
+				auto find = mPalettes.find(bone_palette->mNode.mUID);
+				if (find != mPalettes.end()) {
+					return find->second;
+				}
+			}
+
+			Palette palette;
+
+			if (bone_palette->mNumBones > mBones.size()) {
+				palette.mMatch = PALETTE_TOO_MANY_BONES;
+			}
+			else
+			{
+				palette.mBones.resize(bone_palette->mNumBones);
+
+				for (u32 i = 0; bone_palette->mNumBones > i; ++i)
+				{
+					int index = FindBone(*bone_palette->mBoneUIDTable[i]);
+					if (0 > index)
+					{
+						palette.mMatch = PALETTE_MISSING_BONES;
+						palette.mBones.clear();
+						break;
+					}
+
+					palette.mBones[i] = index;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(mPaletteMutex);
+			return mPalettes.emplace(bone_palette->mNode.mUID, std::move(palette)).first->second;
+		}
+	};
+
+	std::vector<std::unique_ptr<Rig>> gRigs;
+
+	std::mutex gPaletteRigMutex;
+	std::unordered_map<u32, Rig*> gPaletteRigs;
+
+	// Not thread safe, rigs are indexed on the main thread before exporting starts.
+	Rig* Build(RigResource* resource)
+	{
+		for (auto& rig : gRigs)
+		{
+			if (rig->mResource == resource) {
+				return rig.get();
+			}
+		}
+
+		resource->mSkeleton = static_cast<hkaSkeleton*>(NativePackfileUtils::loadInPlace(resource->GetHavokMemImagedData(), resource->mHavokMemImagedDataSize, 0));
+
+		gRigs.emplace_back(new Rig);
+		gRigs.back()->Init(resource);
+
+		return gRigs.back().get();
+	}
+
+	void BuildAll(qResourceInventory* rig_inventory)
+	{
+		for (auto resource : rig_inventory->mResourceDatas) {
+			Build(static_cast<RigResource*>(resource));
+		}
+	}
+
+	// Smallest indexed rig containing every bone of the palette, 0 if none does.
+	Rig* FindRig(Illusion::BonePalette* bone_palette)
+	{
+		{
+			std::lock_guard<std::mutex> lock(gPaletteRigMutex);
+
+			auto find = gPaletteRigs.find(bone_palette->mNode.mUID);
+			if (find != gPaletteRigs.end()) {
+				return find->second;
+			}
+		}
+
+		Signature signature;
+		for (u32 i = 0; bone_palette->mNumBones > i; ++i) {
+			signature.Add(*bone_palette->mBoneUIDTable[i]);
+		}
+
+		Rig* best = 0;
+
+		for (auto& rig : gRigs)
+		{
+			if (!rig->mSignature.MayContain(signature) || (best && rig->mBones.size() >= best->mBones.size())) {
+				continue;
+			}
+
+			if (rig->GetPalette(bone_palette).mMatch == PALETTE_MATCH) {
+				best = rig.get();
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(gPaletteRigMutex);
+		gPaletteRigs.emplace(bone_palette->mNode.mUID, best);
+
+		return best;
+	}
+}
\ No newline at end of file
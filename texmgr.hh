@@ -1,4 +1,18 @@
 #pragma once
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+#ifdef __linux__
+    #include <sys/sendfile.h>
+#endif
 
 struct DDS_PIXELFORMAT
 {
@@ -34,6 +48,11 @@ using namespace UFG;
 
 namespace TextureManager
 {
+    std::mutex gExportMutex;
+    std::unordered_map<u32, std::string> gTextureFiles;
+    std::vector<std::string> gFailedTextures;
+    jobs::TaskPool gExportPool;
+
     void ConvertToDDS(Illusion::Texture* texture, DDS_HEADER& dds)
     {
         auto& ddspf = dds.ddspf;
@@ -145,19 +164,80 @@ namespace TextureManager
         }
     }
 
-    qString* GetFilenameToTexture(Illusion::Texture* data)
+    struct FileRange
     {
-        for (auto loaded_file : StreamResourceLoader::smLoadedFiles)
+        uptr mBegin;
+        uptr mEnd;
+        qString* mFilename;
+
+        bool operator<(const FileRange& other) const { return mBegin < other.mBegin; }
+    };
+
+    // Read-only mapping of a .temp.bin, shared by the queued exports of the perm file it belongs to.
+    struct TempFile
+    {
+        const u8* mData = 0;
+        u64 mSize = 0;
+        u32 mNumPending = 0; // Exports queued by FindTextureFile and not yet finished
+        bool mOpened = 0;
+#ifdef _WIN32
+        HANDLE mFile = INVALID_HANDLE_VALUE;
+        HANDLE mMapping = 0;
+#else
+        int mFd = -1;
+#endif
+
+        bool HasData(Illusion::Texture* texture) const
         {
-            void* data_end = reinterpret_cast<void*>(reinterpret_cast<uptr>(loaded_file->mData) + loaded_file->mDataSize);
-            if (data >= loaded_file->mData && data_end >= data) {
-                return &loaded_file->mFilename;
-            }
+            const u64 end = static_cast<u64>(texture->mImageDataPosition) + texture->mImageDataByteSize;
+            return (mData && mSize >= end);
+        }
+    };
+
+    std::vector<FileRange> gFileRanges;
+    std::vector<TempFile> gTempFiles;
+    std::mutex gTempFileMutex;
+
+    FileRange* FindFileRange(const void* data)
+    {
+        uptr address = reinterpret_cast<uptr>(data);
+
+        auto range = std::upper_bound(gFileRanges.begin(), gFileRanges.end(), FileRange{ address, address, 0 });
+        if (range == gFileRanges.begin()) {
+            return 0;
+        }
+
+        --range;
+        if (address >= range->mBegin && range->mEnd > address) {
+            return &*range;
         }
 
         return 0;
     }
 
+    // Sorts the [mData, mData + mDataSize) range of every loaded file, must be rebuilt whenever files are loaded.
+    void BuildFileRanges()
+    {
+        gFileRanges.clear();
+
+        for (auto loaded_file : StreamResourceLoader::smLoadedFiles)
+        {
+            uptr begin = reinterpret_cast<uptr>(loaded_file->mData);
+            gFileRanges.push_back({ begin, begin + loaded_file->mDataSize, &loaded_file->mFilename });
+        }
+
+        std::sort(gFileRanges.begin(), gFileRanges.end());
+
+        gTempFiles.clear();
+        gTempFiles.resize(gFileRanges.size());
+    }
+
+    qString* GetFilenameToTexture(Illusion::Texture* data)
+    {
+        auto range = FindFileRange(data);
+        return (range ? range->mFilename : 0);
+    }
+
     qString GetFilenameToTextureData(Illusion::Texture* data)
     {
         auto filename = GetFilenameToTexture(data);
@@ -170,67 +250,276 @@ namespace TextureManager
         return tempname;
     }
 
-    void* GetTextureData(Illusion::Texture* texture)
+    bool MapTempFile(TempFile& temp_file, const char* filename)
     {
-        auto filename = GetFilenameToTextureData(texture);
-        if (filename.IsEmpty()) {
+#ifdef _WIN32
+        temp_file.mFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (temp_file.mFile == INVALID_HANDLE_VALUE) {
             return 0;
         }
 
-        void* buffer = qMalloc(texture->mImageDataByteSize);
-        if (buffer) 
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(temp_file.mFile, &size) && size.QuadPart > 0)
         {
-            auto file = qOpen(filename, QACCESS_READ);
-            if (!file)
+            temp_file.mMapping = CreateFileMappingA(temp_file.mFile, 0, PAGE_READONLY, 0, 0, 0);
+            if (temp_file.mMapping)
             {
-                qFree(buffer);
-                return 0;
+                temp_file.mData = static_cast<const u8*>(MapViewOfFile(temp_file.mMapping, FILE_MAP_READ, 0, 0, 0));
+                temp_file.mSize = static_cast<u64>(size.QuadPart);
             }
+        }
+#else
+        // The descriptor stays open so payloads can be copied in kernel (see CopyTextureData).
+        temp_file.mFd = open(filename, O_RDONLY);
+        if (temp_file.mFd == -1) {
+            return 0;
+        }
 
-            qRead(file, buffer, texture->mImageDataByteSize, texture->mImageDataPosition, QSEEK_SET);
-            qClose(file);
+        struct stat st;
+        if (!fstat(temp_file.mFd, &st) && st.st_size > 0)
+        {
+            void* data = mmap(0, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, temp_file.mFd, 0);
+            if (data != MAP_FAILED)
+            {
+                temp_file.mData = static_cast<const u8*>(data);
+                temp_file.mSize = static_cast<u64>(st.st_size);
+            }
         }
+#endif
+        return (temp_file.mData != 0);
+    }
 
-        return buffer;
+    void UnmapTempFile(TempFile& temp_file)
+    {
+#ifdef _WIN32
+        if (temp_file.mData) {
+            UnmapViewOfFile(temp_file.mData);
+        }
+
+        if (temp_file.mMapping) {
+            CloseHandle(temp_file.mMapping);
+        }
+
+        if (temp_file.mFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(temp_file.mFile);
+        }
+
+        temp_file.mFile = INVALID_HANDLE_VALUE;
+        temp_file.mMapping = 0;
+#else
+        if (temp_file.mData) {
+            munmap(const_cast<u8*>(temp_file.mData), static_cast<size_t>(temp_file.mSize));
+        }
+
+        if (temp_file.mFd != -1) {
+            close(temp_file.mFd);
+        }
+
+        temp_file.mFd = -1;
+#endif
+        temp_file.mData = 0;
+        temp_file.mSize = 0;
+        temp_file.mOpened = 0;
     }
 
-    void ExportTexture(Illusion::Texture* texture, const char* filename)
+    // Counts an export of the texture as pending, its .temp.bin stays mapped until every pending export released it.
+    void QueueTempFile(Illusion::Texture* texture)
     {
-        auto file = qOpen(filename, QACCESS_WRITE);
-        if (!file) {
+        auto range = FindFileRange(texture);
+        if (!range) {
             return;
         }
 
+        std::lock_guard<std::mutex> lock(gTempFileMutex);
+        ++gTempFiles[range - gFileRanges.data()].mNumPending;
+    }
+
+    // Returns the mapped .temp.bin that holds the texture payload, must be paired with ReleaseTempFile.
+    TempFile* AcquireTempFile(Illusion::Texture* texture)
+    {
+        auto range = FindFileRange(texture);
+        if (!range) {
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(gTempFileMutex);
+
+        auto& temp_file = gTempFiles[range - gFileRanges.data()];
+        if (!temp_file.mOpened)
+        {
+            temp_file.mOpened = 1;
+            MapTempFile(temp_file, GetFilenameToTextureData(texture));
+        }
+
+        return &temp_file;
+    }
+
+    // Unmaps the .temp.bin (closing its descriptor) once the last pending export of its perm file has been written.
+    void ReleaseTempFile(Illusion::Texture* texture)
+    {
+        auto range = FindFileRange(texture);
+        if (!range) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(gTempFileMutex);
+
+        auto& temp_file = gTempFiles[range - gFileRanges.data()];
+        if (temp_file.mNumPending) {
+            --temp_file.mNumPending;
+        }
+
+        if (!temp_file.mNumPending) {
+            UnmapTempFile(temp_file);
+        }
+    }
+
+    void ReleaseTempFiles()
+    {
+        std::lock_guard<std::mutex> lock(gTempFileMutex);
+
+        for (auto& temp_file : gTempFiles) {
+            UnmapTempFile(temp_file);
+        }
+    }
+
+#ifdef __linux__
+    // Copies the payload file to file in kernel, falls back to sendfile and then to a plain write from the mapping.
+    bool CopyTextureData(const TempFile& temp_file, Illusion::Texture* texture, int out_fd)
+    {
+        off_t offset = static_cast<off_t>(texture->mImageDataPosition);
+        size_t size = texture->mImageDataByteSize;
+
+        while (size)
+        {
+            ssize_t copied = copy_file_range(temp_file.mFd, &offset, out_fd, 0, size, 0);
+            if (0 >= copied) {
+                break;
+            }
+
+            size -= static_cast<size_t>(copied);
+        }
+
+        while (size)
+        {
+            ssize_t sent = sendfile(out_fd, temp_file.mFd, &offset, size);
+            if (0 >= sent) {
+                break;
+            }
+
+            size -= static_cast<size_t>(sent);
+        }
+
+        while (size)
+        {
+            ssize_t written = write(out_fd, &temp_file.mData[offset], size);
+            if (0 >= written) {
+                return 0;
+            }
+
+            offset += written;
+            size -= static_cast<size_t>(written);
+        }
+
+        return 1;
+    }
+#endif
+
+    bool ExportTexture(Illusion::Texture* texture, const char* filename)
+    {
+        PROFILE_SCOPE("ExportTexture", texture->mDebugName);
+
         u32 magic = 0x20534444;
-        qWrite(file, &magic, sizeof(magic));
 
         DDS_HEADER dds;
         {
             qMemSet(&dds, 0, sizeof(dds));
             ConvertToDDS(texture, dds);
         }
-        qWrite(file, &dds, sizeof(dds));
 
-        void* data = GetTextureData(texture);
-        if (data)
+        bool exported = 0;
+        auto temp_file = AcquireTempFile(texture);
+
+#ifdef __linux__
+        int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd != -1)
+        {
+            if (write(fd, &magic, sizeof(magic)) == sizeof(magic) && write(fd, &dds, sizeof(dds)) == sizeof(dds)) {
+                exported = (temp_file && temp_file->HasData(texture) && CopyTextureData(*temp_file, texture, fd));
+            }
+
+            close(fd);
+        }
+#else
+        if (auto file = qOpen(filename, QACCESS_WRITE))
+        {
+            qWrite(file, &magic, sizeof(magic));
+            qWrite(file, &dds, sizeof(dds));
+
+            if (temp_file && temp_file->HasData(texture))
+            {
+                qWrite(file, &temp_file->mData[texture->mImageDataPosition], texture->mImageDataByteSize);
+                exported = 1;
+            }
+
+            qClose(file);
+        }
+#endif
+
+        ReleaseTempFile(texture);
+
+        if (exported)
         {
-            qWrite(file, data, texture->mImageDataByteSize);
-            qFree(data);
+            Profile::Add(Profile::COUNTER_TEXTURES_WRITTEN, 1);
+            Profile::Add(Profile::COUNTER_BYTES_WRITTEN, sizeof(magic) + sizeof(dds) + texture->mImageDataByteSize);
         }
 
-        qClose(file);
+        return exported;
+    }
+
+    // DDS files are written in the background, FindTextureFile only queues them.
+    void StartExportService(u32 num_threads)
+    {
+        gExportPool.Start(num_threads, static_cast<size_t>(num_threads) * 16);
+    }
+
+    // Waits until every queued texture has been written and reports the ones that failed.
+    u32 DrainExportService()
+    {
+        gExportPool.Wait();
+
+        std::lock_guard<std::mutex> lock(gExportMutex);
+
+        for (auto& filename : gFailedTextures) {
+            qPrintf("[ ERROR ] Failed to export texture: %s\n", filename.c_str());
+        }
+
+        u32 num_failed = static_cast<u32>(gFailedTextures.size());
+        gFailedTextures.clear();
+        return num_failed;
     }
 
     qString FindTextureFile(const char* folder, u32 name_uid)
     {
+        {
+            std::lock_guard<std::mutex> lock(gExportMutex);
+
+            auto find = gTextureFiles.find(name_uid);
+            if (find != gTextureFiles.end()) {
+                return find->second.c_str();
+            }
+        }
+
+        // Built with the platform separator, ExportTexture opens the path directly on POSIX.
         qString filename = folder;
         if (!filename.EndsWith("/") && !filename.EndsWith("\\")) {
-            filename += "\\";
+            filename += PATH_SEPARATOR;
         }
 
-        auto texture = static_cast<Illusion::Texture*>(qResourceWarehouse::Instance()->DebugGet(RTypeUID_Texture, name_uid));
+        auto texture = static_cast<Illusion::Texture*>(ResourceIndex::Get(RTypeUID_Texture, name_uid));
         if (!texture)
         {
+            // Not cached, with -stream the texture may still be loaded by a later batch.
             filename.Format("%08X", name_uid);
             return filename;
         }
@@ -238,8 +527,27 @@ namespace TextureManager
         filename += texture->mDebugName;
         filename += ".dds";
 
-        if (!qFileExists(filename)) {
-            ExportTexture(texture, filename);
+        // Only the first caller of a texture stats & queues it, everyone else just references the file.
+        {
+            std::lock_guard<std::mutex> lock(gExportMutex);
+            if (!gTextureFiles.emplace(name_uid, filename.mData).second) {
+                return filename;
+            }
+        }
+
+        if (!qFileExists(filename))
+        {
+            std::string output = filename.mData;
+
+            QueueTempFile(texture);
+            gExportPool.Push([texture, output]()
+            {
+                if (!ExportTexture(texture, output.c_str()))
+                {
+                    std::lock_guard<std::mutex> lock(gExportMutex);
+                    gFailedTextures.push_back(output);
+                }
+            });
         }
 
         return filename;
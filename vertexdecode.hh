@@ -0,0 +1,314 @@
+#pragma once
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <emmintrin.h>
+#if defined(__AVX2__) || defined(__F16C__)
+	#include <immintrin.h>
+#endif
+
+// _mm_cvtph_ps is F16C, GCC/Clang only enable it with -mf16c (MSVC has no macro for it, /arch:AVX2 implies it).
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+	#define VERTEXDECODE_F16C
+#endif
+
+// Vertex decoding is planned once per vertex declaration (stream, offset, stride and kernel per element),
+// then whole vertex lists are converted with SIMD kernels straight into the output arrays.
+
+namespace VertexDecode
+{
+	using namespace UFG;
+
+	enum Kernel : u8
+	{
+		KERNEL_NONE,
+		KERNEL_FLOAT3,	// f32 x3 (or x4, w ignored)
+		KERNEL_BYTE4N,	// u8 x4, [0, 255] -> [-1, 1]
+		KERNEL_HALF2,	// f16 x2
+		KERNEL_U8X4,	// u8 x4 (blend indexes & weights)
+	};
+
+	struct Element
+	{
+		u32 mStream = 0;
+		u32 mOffset = 0;
+		u32 mStride = 0;
+		Kernel mKernel = KERNEL_NONE;
+		bool mPresent = 0;
+
+		bool IsPresent() const { return mPresent; }
+		bool IsValid() const { return mKernel != KERNEL_NONE; }
+
+		// Null when the stream's buffer is missing or doesn't hold last_vertex (streams may live in different buffers).
+		const u8* GetData(Illusion::Mesh* mesh, u32 last_vertex) const
+		{
+			auto buffer = mesh->mVertexBufferHandles[mStream].GetData();
+			if (!buffer || last_vertex >= buffer->mNumElements) {
+				return 0;
+			}
+
+			return static_cast<const u8*>(buffer->mData.Get(mOffset));
+		}
+	};
+
+	struct Plan
+	{
+		Element mPosition;
+		Element mNormal;
+		Element mTexCoord;
+		Element mBlendIndex;
+		Element mBlendWeight;
+	};
+
+	Kernel GetKernel(Illusion::VertexStreamElementUsage usage, u32 type)
+	{
+		switch (usage)
+		{
+		case Illusion::VERTEX_ELEMENT_POSITION:
+			return KERNEL_FLOAT3;
+		case Illusion::VERTEX_ELEMENT_NORMAL:
+		{
+			switch (type)
+			{
+			case Illusion::VERTEX_TYPE_FLOAT3: case Illusion::VERTEX_TYPE_FLOAT4:
+				return KERNEL_FLOAT3;
+			case Illusion::VERTEX_TYPE_BYTE4N:
+				return KERNEL_BYTE4N;
+			}
+		}
+		break;
+		case Illusion::VERTEX_ELEMENT_TEXCOORD0:
+			return (type == Illusion::VERTEX_TYPE_HALF2 ? KERNEL_HALF2 : KERNEL_NONE);
+		case Illusion::VERTEX_ELEMENT_BLENDINDEX: case Illusion::VERTEX_ELEMENT_BLENDWEIGHT:
+			return KERNEL_U8X4;
+		}
+
+		return KERNEL_NONE;
+	}
+
+	void InitElement(Illusion::VertexStreamDescriptor* stream_descriptor, Illusion::VertexStreamElementUsage usage, Element& element)
+	{
+		auto stream_element = core::GetVertexStreamElement(stream_descriptor, usage);
+		if (!stream_element) {
+			return;
+		}
+
+		element.mStream = stream_element->mStream;
+		element.mOffset = stream_element->mOffset;
+		element.mStride = stream_descriptor->GetStreamSize(stream_element->mStream);
+		element.mKernel = GetKernel(usage, stream_element->mType);
+		element.mPresent = 1;
+	}
+
+	std::mutex gPlanMutex;
+	std::unordered_map<u32, Plan> gPlans;
+
+	const Plan* GetPlan(Illusion::VertexStreamDescriptor* stream_descriptor)
+	{
+		std::lock_guard<std::mutex> lock(gPlanMutex);
+
+		auto result = gPlans.emplace(stream_descriptor->mNameUID, Plan());
+		auto& plan = result.first->second;
+
+		if (result.second)
+		{
+			InitElement(stream_descriptor, Illusion::VERTEX_ELEMENT_POSITION, plan.mPosition);
+			InitElement(stream_descriptor, Illusion::VERTEX_ELEMENT_NORMAL, plan.mNormal);
+			InitElement(stream_descriptor, Illusion::VERTEX_ELEMENT_TEXCOORD0, plan.mTexCoord);
+			InitElement(stream_descriptor, Illusion::VERTEX_ELEMENT_BLENDINDEX, plan.mBlendIndex);
+			InitElement(stream_descriptor, Illusion::VERTEX_ELEMENT_BLENDWEIGHT, plan.mBlendWeight);
+		}
+
+		return &plan;
+	}
+
+	//--------------------------------------------------
+	//	Kernels
+	//--------------------------------------------------
+
+	FORCE_INLINE __m128 LoadFloat3(const u8* data)
+	{
+		__m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(data)));
+		__m128 zw = _mm_unpacklo_ps(_mm_load_ss(reinterpret_cast<const f32*>(&data[8])), _mm_set_ss(1.f));
+		return _mm_movelh_ps(xy, zw);
+	}
+
+	FORCE_INLINE __m128 LoadByte4N(const u8* data)
+	{
+		int packed;
+		memcpy(&packed, data, sizeof(packed));
+
+		__m128i zero = _mm_setzero_si128();
+		__m128i bytes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+
+		__m128 xyzw = _mm_sub_ps(_mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(bytes), _mm_set1_ps(255.f)), _mm_set1_ps(2.f)), _mm_set1_ps(1.f));
+		return _mm_shuffle_ps(xyzw, _mm_unpackhi_ps(xyzw, _mm_set1_ps(1.f)), _MM_SHUFFLE(1, 0, 1, 0));
+	}
+
+	// Writes (x, y, z, 1) as doubles.
+	FORCE_INLINE void StoreDouble4(double* out, __m128 xyzw)
+	{
+#ifdef __AVX2__
+		_mm256_storeu_pd(out, _mm256_cvtps_pd(xyzw));
+#else
+		_mm_storeu_pd(out, _mm_cvtps_pd(xyzw));
+		_mm_storeu_pd(&out[2], _mm_cvtps_pd(_mm_movehl_ps(xyzw, xyzw)));
+#endif
+	}
+
+	// 4 halfs (zero extended to 32-bit lanes) to floats.
+	FORCE_INLINE __m128 HalfToFloat(__m128i h)
+	{
+#ifdef VERTEXDECODE_F16C
+		return _mm_cvtph_ps(_mm_packus_epi32(h, h));
+#else
+		const __m128i mask_nosign = _mm_set1_epi32(0x7FFF);
+		const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+		const __m128i was_infnan = _mm_set1_epi32(0x7BFF);
+		const __m128 exp_infnan = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+		__m128i expmant = _mm_and_si128(mask_nosign, h);
+		__m128i justsign = _mm_xor_si128(h, expmant);
+		__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), magic);
+		__m128 infnan = _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(expmant, was_infnan)), exp_infnan);
+		__m128 sign = _mm_castsi128_ps(_mm_slli_epi32(justsign, 16));
+
+		return _mm_or_ps(scaled, _mm_or_ps(sign, infnan));
+#endif
+	}
+
+	//--------------------------------------------------
+	//	Axis Conversion
+	//--------------------------------------------------
+
+	template <core::AxisSystem Axis>
+	FORCE_INLINE __m128 ConvertAxis(__m128 xyzw) { return xyzw; }
+
+	// (x, y, z) -> (x, z, -y)
+	template <>
+	FORCE_INLINE __m128 ConvertAxis<core::AXIS_SYSTEM_Z_UP>(__m128 xyzw)
+	{
+		__m128 xzyw = _mm_shuffle_ps(xyzw, xyzw, _MM_SHUFFLE(3, 1, 2, 0));
+		return _mm_xor_ps(xzyw, _mm_set_ps(0.f, -0.f, 0.f, 0.f));
+	}
+
+	// Bind pose (local translation, quaternion & scale), the conversion is applied as C * local * C^-1.
+	void ConvertTransform(core::AxisSystem axis, double* translation, double* rotation, double* scale)
+	{
+		if (axis != core::AXIS_SYSTEM_Z_UP) {
+			return;
+		}
+
+		double y = translation[1];
+		translation[1] = translation[2];
+		translation[2] = -y;
+
+		y = rotation[1];
+		rotation[1] = rotation[2];
+		rotation[2] = -y;
+
+		y = scale[1];
+		scale[1] = scale[2];
+		scale[2] = y;
+	}
+
+	//--------------------------------------------------
+	//	Decode
+	//--------------------------------------------------
+
+	template <core::AxisSystem Axis>
+	void DecodeVector4(const Element& element, const u8* data, const u32* vertices, u32 count, double* out, u32 out_stride)
+	{
+		switch (element.mKernel)
+		{
+		case KERNEL_FLOAT3:
+		{
+			for (u32 v = 0; count > v; ++v, out += out_stride) {
+				StoreDouble4(out, ConvertAxis<Axis>(LoadFloat3(&data[element.mStride * vertices[v]])));
+			}
+		}
+		break;
+		case KERNEL_BYTE4N:
+		{
+			for (u32 v = 0; count > v; ++v, out += out_stride) {
+				StoreDouble4(out, ConvertAxis<Axis>(LoadByte4N(&data[element.mStride * vertices[v]])));
+			}
+		}
+		break;
+		}
+	}
+
+	// Decodes positions/normals as (x, y, z, 1) doubles in the output axis system, out_stride is in doubles.
+	void DecodeVector4(const Element& element, const u8* data, const u32* vertices, u32 count, double* out, u32 out_stride, core::AxisSystem axis)
+	{
+		switch (axis)
+		{
+		case core::AXIS_SYSTEM_NATIVE:
+			DecodeVector4<core::AXIS_SYSTEM_NATIVE>(element, data, vertices, count, out, out_stride);
+			break;
+		case core::AXIS_SYSTEM_Z_UP:
+			DecodeVector4<core::AXIS_SYSTEM_Z_UP>(element, data, vertices, count, out, out_stride);
+			break;
+		}
+	}
+
+	// Decodes texcoords as (u, 1 - v) doubles, out_stride is in doubles.
+	void DecodeTexCoord(const Element& element, const u8* data, const u32* vertices, u32 count, double* out, u32 out_stride)
+	{
+		if (element.mKernel != KERNEL_HALF2)
+		{
+			for (u32 v = 0; count > v; ++v, out += out_stride) {
+				out[0] = out[1] = 0.0;
+			}
+			return;
+		}
+
+		const __m128d flip_sign = _mm_set_pd(-0.0, 0.0);
+		const __m128d flip_add = _mm_set_pd(1.0, 0.0);
+
+		u32 v = 0;
+		for (; count > (v + 1); v += 2, out += (out_stride * 2))
+		{
+			u32 uv0, uv1;
+			memcpy(&uv0, &data[element.mStride * vertices[v]], sizeof(uv0));
+			memcpy(&uv1, &data[element.mStride * vertices[v + 1]], sizeof(uv1));
+
+			__m128i halfs = _mm_unpacklo_epi16(_mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(uv0)), _mm_cvtsi32_si128(static_cast<int>(uv1))), _mm_setzero_si128());
+			__m128 uvs = HalfToFloat(halfs);
+
+			_mm_storeu_pd(out, _mm_add_pd(_mm_xor_pd(_mm_cvtps_pd(uvs), flip_sign), flip_add));
+			_mm_storeu_pd(&out[out_stride], _mm_add_pd(_mm_xor_pd(_mm_cvtps_pd(_mm_movehl_ps(uvs, uvs)), flip_sign), flip_add));
+		}
+
+		for (; count > v; ++v, out += out_stride)
+		{
+			auto uv = reinterpret_cast<const qHalfFloat*>(&data[element.mStride * vertices[v]]);
+			out[0] = static_cast<double>(uv[0].Get());
+			out[1] = 1.0 - static_cast<double>(uv[1].Get());
+		}
+	}
+
+	// Copies 4 bytes per vertex into a contiguous array.
+	void DecodeU8x4(const Element& element, const u8* data, const u32* vertices, u32 count, u8* out)
+	{
+		for (u32 v = 0; count > v; ++v, out += 4) {
+			memcpy(out, &data[element.mStride * vertices[v]], 4);
+		}
+	}
+
+	// Decodes 4 normalized bytes per vertex as floats into a contiguous array.
+	void DecodeWeights(const Element& element, const u8* data, const u32* vertices, u32 count, f32* out)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 scale = _mm_set1_ps(255.f);
+
+		for (u32 v = 0; count > v; ++v, out += 4)
+		{
+			int packed;
+			memcpy(&packed, &data[element.mStride * vertices[v]], sizeof(packed));
+
+			__m128i bytes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+			_mm_storeu_ps(out, _mm_div_ps(_mm_cvtepi32_ps(bytes), scale));
+		}
+	}
+}
\ No newline at end of file